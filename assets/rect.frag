@@ -0,0 +1,10 @@
+#version 150
+
+flat in vec4 rectColor;
+
+out vec4 fragColor;
+
+void main()
+{
+	fragColor = rectColor;
+}
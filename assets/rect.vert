@@ -0,0 +1,17 @@
+#version 150
+
+in ivec4 rect;
+in vec4 color;
+
+uniform vec2 resolution;
+
+flat out vec4 rectColor;
+
+void main()
+{
+	// Triangle strip corners, the rect covers the pixels from x0 to x1 included
+	vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+	vec2 pos = mix(vec2(rect.xy), vec2(rect.zw + 1), corner);
+	gl_Position = vec4(pos / resolution * 2 - 1, 0.5, 1);
+	rectColor = color;
+}
@@ -0,0 +1,12 @@
+#version 150
+
+uniform sampler2D tex;
+noperspective in vec2 texCoord;
+flat in vec4 spriteColor;
+
+out vec4 fragColor;
+
+void main()
+{
+	fragColor = texture(tex, texCoord) * spriteColor;
+}
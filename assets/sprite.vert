@@ -0,0 +1,21 @@
+#version 150
+
+in ivec4 rect;
+in ivec4 texRect;
+in vec4 color;
+
+uniform vec2 resolution;
+uniform sampler2D tex;
+
+noperspective out vec2 texCoord;
+flat out vec4 spriteColor;
+
+void main()
+{
+	// Triangle strip corners, like the rects, the texture rect is in texels
+	vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+	vec2 pos = mix(vec2(rect.xy), vec2(rect.zw + 1), corner);
+	gl_Position = vec4(pos / resolution * 2 - 1, 0.5, 1);
+	texCoord = mix(vec2(texRect.xy), vec2(texRect.zw), corner) / vec2(textureSize(tex, 0));
+	spriteColor = color;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include "MappedFile.hpp"
+
+// Images converted offline by the asset packer into pixels ready for GL, read from a mapping of the pack.
+// Laid out as a header, an entry per image and format, then the pixels of each, in the packer's byte order.
+class AssetPack
+{
+public:
+    static constexpr char MAGIC[4] = {'S', 'P', 'A', 'K'};
+    static constexpr uint32_t VERSION = 1;
+    static constexpr size_t NAME_SIZE = 56;
+    static constexpr size_t DATA_ALIGNMENT = 64;
+
+    enum Format : uint32_t
+    {
+        rgba8, // Rows first to last, without padding
+        // sRGB, in 4x4 blocks, rows of blocks first to last
+        bc1, // S3TC DXT1, opaque, 8 bytes a block
+        bc3, // S3TC DXT5, 16 bytes a block
+        bc7, // BPTC, 16 bytes a block
+        etc2 // ETC2 with EAC alpha, 16 bytes a block
+    };
+    static const char formatNames[Format::etc2 + 1][8];
+
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t nbEntries;
+        uint32_t reserved;
+    };
+
+    struct Entry
+    {
+        char name[NAME_SIZE]; // Path the image is loaded with, null terminated
+        uint32_t format;
+        uint16_t w, h;
+        uint64_t offset, size; // From the start of the pack
+    };
+
+private:
+    MappedFile file;
+    const Entry *entries = nullptr;
+    uint32_t nbEntries = 0;
+
+public:
+    bool open(const char *path);
+    void close();
+    bool isOpen() const;
+    // Pixels or blocks for an image of that size
+    static size_t getDataSize(Format format, int w, int h);
+    // nullptr when the pack doesn't have it in that format
+    const Entry* find(const char *name, Format format) const;
+    const uint8_t* getData(const Entry &entry) const;
+};
@@ -1,5 +1,11 @@
+#pragma once
+
+#include <map>
+#include <tuple>
 #include <SDL2/SDL.h>
 #include <GL/glew.h>
+#include "GlState.hpp"
+#include "GpuTimer.hpp"
 
 class DisplayWindow
 {
@@ -36,6 +42,10 @@ public:
     int fullscreenDisplay = 0, displayMode = 0;
     int sharpness = 100; // / 100
     bool tripleBuffer;
+    // Of this window's context, ImGui restores what it changes
+    GlState gl;
+    // Window draw and ImGui passes
+    GpuTimer gpuTimer;
 
 private:
     struct ProgramIds
@@ -46,10 +56,15 @@ private:
 
     SyncMode syncMode = SyncMode::noVSync;
     DisplayWindow::ScalingFilter scalingFilter = DisplayWindow::ScalingFilter::bilinear;
-    SDL_GLContext context;
-    GLuint vbo, blurynessUniform, windowSizeUniform, bcUniform, nbIterationsUniform, coverageMultUniform;
+    SDL_GLContext context = nullptr;
+    GLuint vbo = 0, blurynessUniform, windowSizeUniform, bcUniform, nbIterationsUniform, coverageMultUniform;
     ProgramIds bilinearProgram, pixelAverageProgram, bicubicProgram, lanczos3Program;
     bool canVSync, canNoVSync, canAdaptiveSync;
+    // Window mode, display and display mode
+    std::map<std::tuple<int8_t, int, int>, bool> tripleBufferModes;
+
+    void loadPrograms();
+    void createVertexArrays();
 
 public:
     void create();
@@ -61,6 +76,7 @@ public:
     void setScalingFilter(ScalingFilter filter);
     void draw();
     void swap();
+    // Keeps the context, the programs and ImGui for the next create()
     void destroy();
 
 };
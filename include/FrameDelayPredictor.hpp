@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+
+// Chooses how long to wait after a vblank before starting the frame, from the distribution of the recent frame
+// costs. The wait leaves room for the cost that is only exceeded by the target proportion of frames, plus a margin
+// that grows when a vblank is missed and slowly shrinks back otherwise.
+class FrameDelayPredictor
+{
+public:
+    enum Cost : int8_t
+    {
+        update,
+        draw,
+        other, // Events, UI and GPU sync before the swap
+        total
+    };
+
+    static const char costNames[Cost::total + 1][16];
+
+private:
+    static constexpr uint8_t NB_FRAMES = 64;
+    static constexpr uint8_t MIN_FRAMES = 16;
+    static constexpr int64_t MIN_MARGIN = 200;
+    static constexpr int64_t MAX_MARGIN = 8000;
+    static constexpr int64_t MARGIN_STEP = 500;
+    static constexpr int64_t MARGIN_DECAY = 5;
+
+    std::array<std::array<int32_t, NB_FRAMES>, Cost::total + 1> costs;
+    uint8_t nbFrames = 0, currentFrame = 0;
+    int64_t margin = MIN_MARGIN;
+    int64_t predictedCost = 0;
+    uint32_t nbMissedSyncs = 0;
+
+public:
+    float missRate = 0.01f;
+
+    FrameDelayPredictor();
+    void reset();
+    void addFrame(int64_t updateCost, int64_t drawCost, int64_t otherCost, bool missedSync);
+    int64_t getWaitTime(int64_t refreshPeriod) const;
+    int64_t getPercentile(Cost cost, float p) const;
+    int64_t getMargin() const;
+    uint32_t getNbMissedSyncs() const;
+};
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include "Inputs.hpp"
+#include "PreciseWait.hpp"
+#include "FrameDelayPredictor.hpp"
+#include "TripleBuffer.hpp"
+#include "Rollback.hpp"
+#include "DisplayWindow.hpp"
+#include "Scenes/Scene.hpp"
+
+class Replay;
+
+// Frame pacing, independant of where time, inputs and vblanks come from.
+// The same code drives the real window and the headless simulation.
+class GameLoop
+{
+public:
+    enum InputLagMitigation : int8_t
+    {
+        none,
+        gpuSync,
+        frameDelay
+    };
+
+    enum Timestep : int8_t
+    {
+        fixed,
+        interpolation,
+        loose,
+        looseInterpolation
+    };
+
+    // With an update thread, the scene is updated at the exact update rate whatever the display does,
+    // and each frame draws the newest state it published
+    enum Threading : int8_t
+    {
+        singleThread,
+        updateThread
+    };
+
+    static const char inputLagMitigationNames[InputLagMitigation::frameDelay + 1][40];
+    static const char timestepNames[Timestep::looseInterpolation + 1][40];
+    static const char threadingNames[Threading::updateThread + 1][40];
+
+    class Clock
+    {
+    public:
+        virtual ~Clock() {}
+        virtual int64_t getTimeMicroseconds() = 0;
+        // Give the CPU back until roughly the given time, then spin until it
+        virtual void waitUntil(int64_t microseconds) = 0;
+        // Burn CPU until the given time, used to simulate update cost
+        virtual void spinUntil(int64_t microseconds) = 0;
+    };
+
+    class Display
+    {
+    public:
+        virtual ~Display() {}
+        virtual DisplayWindow::SyncMode getSyncMode() const = 0;
+        virtual int64_t getRefreshPeriod() = 0;
+        // Draws the given copy of the scene state, or its current state when null,
+        // alpha of the way from the previous tick with an interpolation timestep
+        virtual void draw(Scene &scene, const void *state, float alpha, uint16_t simulatedDrawTime) = 0;
+        virtual void swap() = 0;
+        virtual void gpuHardSync() = 0;
+        // Called after the swap of a resync frame
+        virtual void resync() {}
+    };
+
+    class InputSource
+    {
+    public:
+        virtual ~InputSource() {}
+        virtual Inputs::State getState() = 0;
+    };
+
+    static constexpr uint8_t MAX_RUN_AHEAD = 4;
+
+    int updateRate = 120;
+    int simulatedUpdateTime = 0; // * 100µs
+    int randomUpdateTime = 0;
+    int simulatedDrawTime = 0; // Arbitrary units
+    int randomDrawTime = 0;
+    InputLagMitigation inputLagMitigation = InputLagMitigation::none;
+    Timestep timestep = Timestep::fixed;
+    Threading threading = Threading::singleThread;
+    // Ticks simulated past the present with the latest inputs before drawing, then rolled back
+    int runAhead = 0;
+    // Two player session, the ticks go through it. Forces a single thread and whole ticks.
+    Rollback *rollback = nullptr;
+    // Records or plays the inputs of every tick. Locks the update rate and timestep while active.
+    Replay *replay = nullptr;
+    FrameDelayPredictor frameDelayPredictor;
+
+private:
+    static constexpr uint8_t MAX_UPDATE_FRAMES_DIV = 10;
+    static constexpr uint8_t NB_FRAME_TIMES = 16;
+
+    Clock &clock;
+    Display &display;
+    InputSource *inputSource;
+
+    bool missedSync = true;
+    bool resyncRequested = false;
+    bool useSavedInputs = false;
+    Inputs::State savedInputs;
+
+    // Chrono
+    int64_t startTime;
+    int64_t prevUseconds;
+    int64_t toUpdate = 0;
+    int64_t addToUpdate = 0;
+    std::array<int64_t, NB_FRAME_TIMES> frameTimes;
+    std::array<int64_t, NB_FRAME_TIMES> iterationTimes;
+    const Scene *predictedScene = nullptr;
+    uint8_t currentFrame = 0;
+    uint16_t frameRate = 0;
+    float drawAlpha = 1.f;
+    std::atomic<uint32_t> nbTicks;
+
+    // Update thread
+    struct Snapshot
+    {
+        const Scene *scene = nullptr;
+        uint32_t tick = 0;
+        std::vector<uint8_t> state;
+    };
+
+    TripleBuffer<Snapshot> snapshots;
+    std::thread updater;
+    std::atomic<bool> updaterRunning;
+    std::mutex updateMutex;
+    Scene *updatedScene = nullptr;
+    PreciseWait updaterWait; // Not the clock's, whose stats belong to the main thread
+
+    std::atomic<uint32_t> runAheadCost; // ns per run-ahead tick, moving average
+
+    Inputs::State nextInputs();
+    Inputs::State heldInputs();
+    void tick(Scene &scene, int64_t microseconds, Inputs::State inputs);
+    void gpuHardSync();
+    void runAheadTicks(Scene &scene, Inputs::State inputs, int nbTicks);
+    uint8_t updateScene(Scene &scene, int64_t dToUpdate);
+    void startUpdater();
+    void stopUpdater();
+    void updaterLoop();
+    void endThreadedFrame(Scene &scene);
+
+public:
+    GameLoop(Clock &clock, Display &display, InputSource &inputSource);
+    ~GameLoop();
+    // Start of an iteration, before polling events and building the UI
+    void beginFrame();
+    // Update, draw and present the scene
+    void endFrame(Scene &scene);
+    // Restart time accumulation after the next swap, to sync update and display rates
+    void requestResync();
+    void setInputSource(InputSource &inputSource);
+    uint16_t getFrameRate() const;
+    uint32_t getIterationTime() const;
+    bool hasMissedSync() const;
+    uint32_t getNbTicks() const;
+    // CPU time of each tick simulated ahead, µs
+    float getRunAheadCost() const;
+    // Held by the update thread during each tick. Hold it to change the settings or the scene from another thread.
+    std::mutex& getUpdateMutex();
+};
+
+// Real time, waiting with the OS scheduler then spinning for precision
+class SystemClock : public GameLoop::Clock
+{
+public:
+    PreciseWait preciseWait;
+
+    int64_t getTimeMicroseconds() override;
+    void waitUntil(int64_t microseconds) override;
+    void spinUntil(int64_t microseconds) override;
+};
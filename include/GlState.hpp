@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <GL/glew.h>
+
+// Last values set in one context, so setting them again costs no GL call. Everything changed without it, by
+// setup code or deleting bound objects, must be followed by invalidate(). GL_ARRAY_BUFFER is left to the stream buffer.
+class GlState
+{
+private:
+    GLuint program, vertexArray, framebuffer, texture;
+    GLenum activeTextureUnit;
+    GLint scissorBox[4], viewportBox[4];
+    GLfloat clearColorValue[4];
+    int8_t blend; // -1 unknown
+    GLenum blendSrc, blendDst;
+    uint32_t frameIssued = 0, frameElided = 0, nbIssued = 0, nbElided = 0;
+
+    bool needsCall(bool changed);
+
+public:
+    GlState();
+    void invalidate();
+    void useProgram(GLuint program);
+    void bindVertexArray(GLuint vertexArray);
+    void bindFramebuffer(GLuint framebuffer);
+    void activeTexture(GLenum unit);
+    // GL_TEXTURE_2D on the active unit
+    void bindTexture(GLuint texture);
+    void scissor(GLint x, GLint y, GLsizei w, GLsizei h);
+    void viewport(GLint x, GLint y, GLsizei w, GLsizei h);
+    void clearColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a);
+    void setBlend(bool enabled);
+    void blendFunc(GLenum src, GLenum dst);
+    // Keeps the counts of the frame
+    void endFrame();
+    uint32_t getNbIssued() const;
+    uint32_t getNbElided() const;
+};
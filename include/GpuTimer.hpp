@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <GL/glew.h>
+
+// GPU time of the passes drawn in one context, from timestamp queries read back a few frames later without waiting
+// for them. Needs GL 3.3 or ARB_timer_query and does nothing otherwise. One per context, passes can't overlap.
+class GpuTimer
+{
+public:
+    enum Pass : uint8_t
+    {
+        longDraw,
+        sceneDraw,
+        windowDraw,
+        imGui
+    };
+
+    static const char passNames[Pass::imGui + 1][16];
+
+    static constexpr uint8_t NB_FRAMES = 4; // Queries in flight, a frame still running after that many is dropped
+    static constexpr uint16_t HISTORY_SIZE = 240;
+    static constexpr uint32_t RESYNC_PERIOD = 600; // Frames between two readings of the GPU clock
+
+private:
+    struct Frame
+    {
+        GLuint queries[Pass::imGui + 1][2]; // Begin, end
+        bool issued[Pass::imGui + 1];
+        bool pending;
+        uint32_t telemetryFrame;
+    };
+
+    bool supported = false;
+    Frame frames[NB_FRAMES] = {};
+    uint8_t current = 0;
+    uint32_t nbFrames = 0, nbDropped = 0;
+    int64_t clockOffset = 0; // From the GPU clock to TimeSource's, ns
+    float history[Pass::imGui + 1][HISTORY_SIZE] = {}; // µs
+    uint16_t historyPos[Pass::imGui + 1] = {}, nbSamples[Pass::imGui + 1] = {};
+
+    void syncClocks();
+    bool isDone(const Frame &frame) const;
+    void collect(Frame &frame);
+
+public:
+    // With the context current, again for each new context
+    void init();
+    void begin(Pass pass);
+    void end(Pass pass);
+    // Reads the frames the GPU is done with, oldest first, and moves to the next one
+    void endFrame();
+    bool isSupported() const;
+    // Ring of the last durations, µs, starting at the offset
+    const float* getHistory(Pass pass) const;
+    uint16_t getHistoryOffset(Pass pass) const;
+    uint16_t getNbSamples(Pass pass) const;
+    float getPercentile(Pass pass, float p) const;
+    uint32_t getNbDropped() const;
+};
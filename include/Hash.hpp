@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// FNV-1a, to compare states between runs and between instances
+static constexpr uint64_t HASH_SEED = 14695981039346656037ull;
+
+inline uint64_t hashBytes(const void *data, size_t size, uint64_t hash = HASH_SEED)
+{
+    const uint8_t *bytes = static_cast<const uint8_t*>(data);
+    for(size_t i = 0; i < size; i++) hash = (hash ^ bytes[i]) * 1099511628211ull;
+    return hash;
+}
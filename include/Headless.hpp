@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <ostream>
+#include "GameLoop.hpp"
+#include "Hash.hpp"
+#include "Scenes/TickStates.hpp"
+
+// Time only advances when the game loop waits, spins or is blocked by the simulated display
+class SimulatedClock : public GameLoop::Clock
+{
+private:
+    int64_t time = 0;
+
+public:
+    int64_t getTimeMicroseconds() override;
+    void waitUntil(int64_t microseconds) override;
+    void spinUntil(int64_t microseconds) override;
+    void advance(int64_t microseconds);
+};
+
+// Periodic presses, sampling times are recorded to measure latency
+class SimulatedInputs : public GameLoop::InputSource
+{
+private:
+    static constexpr int64_t PRESS_PERIOD = 250000;
+
+    SimulatedClock &clock;
+
+public:
+    int64_t lastSampleTime = 0;
+
+    SimulatedInputs(SimulatedClock &clock);
+    Inputs::State getState() override;
+};
+
+// Fake GPU and vblanks. The GPU renders frames in order, presentation waits for the vblank
+// if V-Sync is on, and a swap blocks while the previous frame is not on screen yet.
+class SimulatedDisplay : public GameLoop::Display
+{
+private:
+    static constexpr int64_t GPU_TIME_PER_DRAW_UNIT = 20;
+
+    SimulatedClock &clock;
+    SimulatedInputs &inputs;
+    int64_t refreshPeriod;
+    int64_t gpuDoneTime = 0, lastPresentTime = 0, frameInputTime = 0;
+
+    int64_t nextVBlank(int64_t time) const;
+
+public:
+    DisplayWindow::SyncMode syncMode = DisplayWindow::vSync;
+    int64_t cpuDrawTime = 500;
+    int64_t gpuBaseTime = 1000;
+    std::vector<int64_t> latencies;
+
+    SimulatedDisplay(SimulatedClock &clock, SimulatedInputs &inputs, int refreshRate);
+    DisplayWindow::SyncMode getSyncMode() const override;
+    int64_t getRefreshPeriod() override;
+    void draw(Scene &scene, const void *state, float alpha, uint16_t simulatedDrawTime) override;
+    void swap() override;
+    void gpuHardSync() override;
+};
+
+// Records when updates happen instead of simulating anything, and the simulated time each frame draws
+class SimulatedScene : public Scene
+{
+private:
+    SimulatedClock &clock;
+    TickStates<int64_t> times;
+    int64_t lastDrawnTime = INT64_MIN;
+
+public:
+    std::vector<int64_t> updateTimes;
+    uint32_t nbBackwardDraws = 0; // Frames drawing an earlier time than the one before
+
+    SimulatedScene(SimulatedClock &clock);
+    void update(uint64_t microseconds, Inputs::State inputs) override;
+    void drawInterpolated(float alpha) override;
+    // The next draw isn't compared with the previous ones
+    void restartDrawCheck();
+};
+
+// Hashes every input it is given, so its state only matches a recording if all of them were played back
+class InputHashScene : public Scene
+{
+private:
+    uint64_t hash = HASH_SEED;
+
+public:
+    InputHashScene();
+    void update(uint64_t microseconds, Inputs::State inputs) override;
+    uint64_t hashState() const override;
+};
+
+// Run every Timestep × SyncMode × InputLagMitigation combination against the fake clock and display.
+// False if any of them drew a frame earlier in time than the previous one.
+bool runHeadlessSweep(std::ostream &out, int64_t duration);
+
+// Records the simulated presses to the file, plays it back and checks every tick's hash matched
+bool runReplayCheck(std::ostream &out, const char *path);
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <SDL2/SDL.h>
+#include "SpscQueue.hpp"
+
+// Reads the input devices on its own thread and timestamps every change.
+// The SDL backend polls the joysticks at a fixed rate, the keyboard stays on the main thread since SDL only pumps
+// window events there.
+// The evdev backend, on Linux, blocks on every /dev/input/event* keyboard and joystick, with the kernel timestamps.
+class InputThread
+{
+public:
+    enum Backend : int8_t
+    {
+        sdl,
+        evdev
+    };
+
+    static const char backendNames[Backend::evdev + 1][8];
+
+    enum Kind : uint8_t
+    {
+        button,
+        hat,
+        axis,
+        key // Linux key code, evdev keyboards only
+    };
+
+    struct Transition
+    {
+        int64_t time; // ns, TimeSource
+        uint8_t joystick;
+        Kind kind;
+        uint16_t index;
+        int16_t value;
+    };
+
+    struct JoystickState
+    {
+        std::vector<uint8_t> buttons, hats;
+        std::vector<int16_t> axes;
+    };
+
+    static constexpr uint16_t NB_KEY_CODES = 0x300;
+
+private:
+    static constexpr uint32_t QUEUE_SIZE = 1024; // Power of two
+    static constexpr int EVDEV_TIMEOUT = 20; // ms, to notice stop
+    static constexpr int EVDEV_BATCH = 64;
+
+    struct EvdevDevice
+    {
+        int fd;
+        bool keyboard;
+        bool dropped; // Events were lost, resynchronize from the kernel state at the next report
+        bool delayed; // Transitions didn't fit the queue, same
+        int32_t axisMin[2], axisMax[2];
+        int8_t hatX, hatY;
+        std::vector<uint8_t> keys;
+    };
+
+    Backend backend = sdl;
+    std::vector<SDL_Joystick*> joysticks;
+    std::vector<EvdevDevice> evdevDevices;
+    int epollFd = -1;
+    std::vector<JoystickState> polled;
+    SpscQueue<Transition, QUEUE_SIZE> queue;
+    std::atomic<bool> running;
+    std::atomic<uint32_t> delayed;
+    std::thread thread;
+    int64_t period = 0; // ns
+
+    bool push(uint8_t joystick, Kind kind, uint16_t index, int16_t value, int64_t time);
+    void poll();
+    void loop();
+    bool openEvdev();
+    void closeEvdev();
+    void evdevLoop();
+    void applyEvdev(uint8_t iDevice, uint16_t type, uint16_t code, int32_t value, int64_t time);
+    void resyncEvdev(uint8_t iDevice, int64_t time);
+
+public:
+    InputThread();
+    ~InputThread();
+    // Must be called while stopped, gives the initial state of each device.
+    // Only the SDL joysticks are used by the SDL backend, the evdev backend fails when it can't open any device.
+    bool open(Backend backend, const std::vector<SDL_Joystick*> &joysticks, std::vector<JoystickState> &states);
+    Backend getBackend() const;
+    // Whether key transitions replace the SDL keyboard
+    bool hasKeyboard() const;
+    // The rate is only used by the SDL backend
+    bool start(int rate);
+    void stop();
+    bool isRunning() const;
+    bool pop(Transition &transition);
+    // Transitions that found the queue full, they are pushed again later
+    uint32_t getNbDelayed() const;
+};
@@ -1,22 +1,102 @@
 #pragma once
 
 #include <vector>
+#include <bitset>
+#include <mutex>
+#include <thread>
+#include <cstdint>
 #include <SDL2/SDL.h>
+#include "InputThread.hpp"
 
 class Inputs
 {
+    public:
+        struct State
+        {
+            int16_t x, y;
+            uint32_t pressAge; // µs between the arrival of the press and this sample, 0 when unknown
+            bool pressed : 1, ack0 : 1, ack1 : 1, reset : 1;
+        };
+
+        enum ScriptInput : uint8_t
+        {
+            pressed,
+            ack0,
+            ack1,
+            reset
+        };
+
+        static const char scriptInputNames[ScriptInput::reset + 1][8];
+
+        // Delay of the SDL key events after the evdev ones, for the same presses
+        struct KeyDelay
+        {
+            uint32_t count = 0;
+            int64_t total = 0, max = 0; // ns
+        };
+
     private:
+        struct ScriptEvent
+        {
+            int64_t time; // µs from the first getState
+            ScriptInput input;
+            bool value;
+        };
+
+        static constexpr int EVENT_BATCH = 64;
+
         std::vector<SDL_Joystick*> joysticks;
+        std::vector<SDL_JoystickID> joystickIds;
+        InputThread inputThread;
+        // getState can be called by the update thread, but only the main thread may pump SDL events
+        std::mutex mutex;
+        std::thread::id mainThread;
+
+        // Device state, only updated by events and transitions
+        std::vector<InputThread::JoystickState> joystickStates;
+        // SDL scancodes, then evdev key codes
+        std::bitset<SDL_NUM_SCANCODES + InputThread::NB_KEY_CODES> keys;
+        // Held keys, buttons and hats that count as a press. Only the ones from the input thread have an arrival time.
+        int nbKeyPresses = 0, nbTimedPresses = 0;
+        int64_t lastPressTime = 0; // ns, when the first of the timed presses arrived
+        int64_t lastEvdevKeyTime = 0; // ns, 0 once an SDL key event matched it
+        KeyDelay sdlKeyDelay;
+        bool xyChanged = false;
+        State live;
+
+        // Events taken from the SDL queue in order, keys applied as they are taken, until pollEvent returns them
+        std::vector<SDL_Event> events;
+        size_t eventPos = 0;
+
+        // Injected inputs, replacing the devices when not empty
+        std::vector<ScriptEvent> script;
+        size_t scriptPos = 0;
+        int64_t scriptStart = -1, scriptRepeat = 0;
+        State scriptState;
 
-        bool isAnyInputPressed() const;
         std::pair<int16_t, int16_t> getXY() const;
+        void applyScriptEvent(const ScriptEvent &event);
+        State getScriptState();
+        // Time is 0 for the untimed SDL keyboard
+        void applyKey(int key, bool down, int64_t time);
+        void applyTransition(const InputThread::Transition &transition);
+        bool toTransition(const SDL_Event &event, InputThread::Transition &transition) const;
+        void processEvents(bool pump);
 
     public:
-        struct State
-        {
-            int16_t x, y;
-            bool pressed : 1, ack0 : 1, ack1 : 1, test : 1, reset : 1;
-        };
-        void init();
+        // The SDL backend polls the joysticks on a thread at rate Hz, or uses their events when 0.
+        // Falls back to SDL when evdev isn't available.
+        void init(InputThread::Backend backend = InputThread::sdl, int rate = 1000);
+        InputThread::Backend getBackend() const;
+        uint32_t getNbDelayedTransitions() const;
+        const KeyDelay& getSdlKeyDelay() const;
         State getState();
+        // Replaces SDL_PollEvent, so the key events reach both the caller and the input state
+        bool pollEvent(SDL_Event &event);
+        // One "<time ms> <input> <0|1>" per line, sorted by time, and optionally "repeat <period ms>"
+        bool loadScript(const char *path);
+        // Presses every period, each input acknowledged after its reaction time, which must be shorter than 3/4 period
+        void generateScript(uint16_t nbPresses, int64_t period, int64_t reaction0, int64_t reaction1);
+        bool isScripted() const;
+        bool isScriptFinished() const;
 };
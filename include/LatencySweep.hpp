@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+#include "GameLoop.hpp"
+
+// Unattended input lag measurements over every combination of the configured settings.
+// It presses a button itself, and acknowledges it once a frame that consumed the press has been swapped.
+// Runs in the single thread mode, where getState and afterFrame are both called from the main loop.
+// Each press gives one sample: the time from the press being due to the end of the swap, and the number of
+// ticks simulated meanwhile.
+class LatencySweep : public GameLoop::InputSource
+{
+public:
+    enum Step : int8_t
+    {
+        running,
+        nextConfig,
+        done
+    };
+
+    struct Config
+    {
+        std::vector<int> updateRates {60};
+        std::vector<int> drawTimes {0};
+        std::vector<DisplayWindow::SyncMode> syncModes {DisplayWindow::noVSync, DisplayWindow::vSync};
+        std::vector<GameLoop::InputLagMitigation> mitigations {GameLoop::none, GameLoop::gpuSync, GameLoop::frameDelay};
+        std::vector<GameLoop::Timestep> timesteps {GameLoop::fixed};
+        uint16_t repetitions = 1;
+        int64_t duration = 10000000; // µs
+        int64_t warmup = 1000000; // µs
+        std::string output = "sweep.csv";
+    };
+
+    struct Run
+    {
+        int updateRate, drawTime;
+        DisplayWindow::SyncMode syncMode;
+        GameLoop::InputLagMitigation mitigation;
+        GameLoop::Timestep timestep;
+        uint16_t repetition;
+    };
+
+private:
+    static constexpr int64_t HOLD_TIME = 50000;
+    static constexpr int64_t MIN_GAP = 100000, MAX_GAP = 300000;
+
+    bool enabled = false;
+    bool invalid = false; // A setting couldn't be read, the sweep stays off
+    std::vector<Run> runs;
+    size_t currentRun = 0;
+    int64_t runStart = 0;
+    std::ofstream output;
+
+    // Injected input
+    GameLoop *loop = nullptr;
+    bool pressed = false, acked = false;
+    int64_t pressTime = 0, nextPressTime = 0, releaseTime = 0;
+    uint32_t pressTicks = 0;
+    uint32_t random = 1;
+    std::vector<int64_t> latencies;
+    std::vector<uint32_t> ticks;
+
+    bool parseSetting(const std::string &key, const std::string &value);
+    void startRun(int64_t now);
+    void endRun();
+
+public:
+    Config config;
+
+    // Recognizes --sweep and --sweep-<setting>=<value>. --sweep=<file> reads one <setting>=<value> per line.
+    bool parseArgument(const char *arg);
+    bool isEnabled() const;
+    const Run& getRun() const;
+    bool start(GameLoop &loop);
+    // Call after each frame, the caller must apply the sync mode of the new run when it returns nextConfig
+    Step afterFrame();
+    Inputs::State getState() override;
+};
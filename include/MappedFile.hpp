@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// Read-only view of a whole file, paged in by the OS as it is read
+class MappedFile
+{
+private:
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+#ifdef _WINDOWS
+    void *file = nullptr, *mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+    bool open(const char *path);
+    void close();
+    const uint8_t* getData() const;
+    size_t getSize() const;
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+
+// Sleeps until a bit before an absolute deadline, then spins for the rest.
+// The margin left for spinning follows the measured oversleep of the OS timer,
+// instead of a fixed value that is either too short or burns a lot of CPU.
+class PreciseWait
+{
+public:
+    static constexpr uint8_t NB_BUCKETS = 16; // Bucket i counts errors in [2^i - 1, 2^(i+1) - 1) µs
+
+    struct Stats
+    {
+        std::array<uint32_t, NB_BUCKETS> oversleep; // Wake-up time after the sleep target
+        std::array<uint32_t, NB_BUCKETS> lateness;  // Return time after the deadline
+        uint32_t nbWaits;
+        int64_t totalSleep, totalSpin;
+    };
+
+private:
+    static constexpr int64_t INITIAL_MARGIN = 2000;
+    static constexpr int64_t MIN_MARGIN = 50;
+    static constexpr uint8_t NB_SAMPLES = 128;
+    static constexpr uint8_t RECOMPUTE_PERIOD = 16;
+
+    std::array<int32_t, NB_SAMPLES> samples;
+    uint8_t nbSamples = 0, currentSample = 0, samplesSinceRecompute = 0;
+    int64_t margin = INITIAL_MARGIN;
+    Stats stats;
+
+    static uint8_t getBucket(int64_t error);
+    void addSample(int64_t oversleep);
+
+public:
+    float percentile = 0.99f; // Proportion of sleeps that must wake up before the deadline
+
+    PreciseWait();
+    void waitUntil(int64_t deadline);
+    int64_t getMargin() const;
+    const Stats& getStats() const;
+    void resetStats();
+};
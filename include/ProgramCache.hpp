@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <GL/glew.h>
+
+// Linked program binaries saved on disk, keyed by the hash of the sources and of the driver that built them, so
+// the shaders are compiled once per driver instead of at each start and window creation
+class ProgramCache
+{
+public:
+    struct Stats
+    {
+        uint32_t nbPrograms = 0, nbCached = 0;
+        int64_t time = 0; // Reading, compiling and linking, ns
+    };
+
+    bool enabled = true;
+    std::string directory = "shader_cache";
+
+private:
+    int8_t supported = -1; // Unknown until a context is current
+    std::string driver;
+    Stats stats;
+
+    bool isSupported();
+    std::string getPath(uint64_t key) const;
+
+public:
+    uint64_t getKey(const std::string &vertSource, const std::string &fragSource);
+    // Program linked from the saved binary, 0 when there is none or the driver rejects it
+    GLuint load(uint64_t key);
+    // Before linking a program to save
+    void prepare(GLuint program);
+    void save(uint64_t key, GLuint program);
+    void addProgram(bool cached, int64_t time);
+    const Stats& getStats() const;
+};
+
+extern ProgramCache programCache;
@@ -1,32 +1,70 @@
 #pragma once
 #include <cstdint>
+#include <vector>
 #include <SDL2/SDL.h>
 #include <GL/glew.h>
+#include "StreamBuffer.hpp"
+#include "GlState.hpp"
+#include "GpuTimer.hpp"
 
 static constexpr uint16_t NATIVE_RES_X = 1024;
 static constexpr uint16_t NATIVE_RES_Y = 768;
 
 class Renderer
 {
+    public:
+        // Linear, like the clear color
+        struct Color
+        {
+            uint8_t r, g, b, a;
+        };
+
+        static constexpr Color WHITE = {255, 255, 255, 255};
+
     private:
+        struct RectInstance
+        {
+            int16_t x0, y0, x1, y1;
+            Color color;
+        };
+
         GLuint fbo;
         SDL_GLContext context;
         SDL_Window *window;
-        GLuint textureProgram, textureVbo, textureVao;
+        GLuint textureProgram, textureVao, texturePosAttrib, textureCoordAttrib;
         GLuint longProgram, longVbo, longVao;
+        GLuint rectProgram, rectVao, rectAttrib, rectColorAttrib;
+        bool instancing = false;
+        std::vector<RectInstance> rects;
+        int64_t rectFlushTime = 0;
+        uint32_t nbFlushedRects = 0;
 
     public:
         GLuint texture;
+        // Rects, sprites and texture rects of the frame
+        StreamBuffer stream;
+        // Of this context, drawing sets what it needs and unbinds nothing
+        GlState gl;
+        // Long draw and scene passes
+        GpuTimer gpuTimer;
 
         void init();
         void useContext();
         void beginDrawFrame(GLsync sync);
         void endDrawFrame();
-        GLuint loadTexture(const char* path);
-        void rect(int16_t x0, int16_t y0, int16_t x1, int16_t y1);
+        // Batched, all drawn in one instanced call before the next other draw or at the end of the frame
+        void rect(int16_t x0, int16_t y0, int16_t x1, int16_t y1, Color color = WHITE);
+        // One scissored clear per rect, to compare, and without instanced arrays
+        void clearRect(int16_t x0, int16_t y0, int16_t x1, int16_t y1, Color color = WHITE);
         void textureRect(GLuint texture, int16_t x0, int16_t y0, int16_t x1, int16_t y1);
         void longDraw(uint16_t instances);
+        void flushRects();
+        // CPU time to upload and draw the last batch of rects, ns
+        int64_t getRectFlushTime() const;
+        uint32_t getNbFlushedRects() const;
         static GLuint loadShaders(const char* vert, const char* frag);
+        // One step per instance, through the extension's entry point when GL is older than 3.3
+        static void setInstanceDivisor(GLuint attrib);
 };
 
 extern Renderer renderer;
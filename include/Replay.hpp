@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <fstream>
+#include <ostream>
+#include "GameLoop.hpp"
+#include "MappedFile.hpp"
+
+// Inputs of every tick and the hash of the state after it, to play a session again through the same scene
+// and compare timings between builds and settings. The update rate and timestep are locked while it runs.
+class Replay
+{
+public:
+    enum Mode : uint8_t
+    {
+        off,
+        recording,
+        playing,
+        finished
+    };
+
+    static const char modeNames[Mode::finished + 1][16];
+
+private:
+    static constexpr char MAGIC[5] = "DSRP";
+    static constexpr uint8_t VERSION = 2;
+    static constexpr size_t HEADER_SIZE = 40; // Magic, version, timestep, update rate, scene name
+    static constexpr size_t TICK_SIZE = 17; // x, y, buttons, press age, hash
+
+    Mode mode = off;
+    char sceneName[32] = "";
+    int updateRate = 0;
+    GameLoop::Timestep timestep = GameLoop::fixed;
+    const Scene *scene = nullptr;
+
+    std::ofstream out;
+    MappedFile in;
+    uint32_t nbTicks = 0, tickPos = 0;
+    uint32_t nbMismatches = 0, firstMismatch = 0;
+
+    // Per frame, µs
+    int64_t lastFrameStart = 0;
+    std::vector<int64_t> frameTimes, updateTimes, drawTimes;
+
+public:
+    ~Replay();
+    bool record(const char *path, const Scene &scene, const GameLoop &loop);
+    bool play(const char *path);
+    void stop();
+    Mode getMode() const;
+    bool isActive() const;
+    const char* getSceneName() const;
+    int getUpdateRate() const;
+    GameLoop::Timestep getTimestep() const;
+    uint32_t getNbTicks() const;
+    uint32_t getTickPos() const;
+    uint32_t getNbMismatches() const;
+
+    // Around each scene update. Playback replaces the inputs with the recorded ones.
+    Inputs::State beginTick(Inputs::State inputs);
+    void endTick(const Scene &scene, Inputs::State inputs);
+    void addFrame(int64_t frameStart, int64_t updateTime, int64_t drawTime);
+    // Hash check result, then mean and percentiles of the frame, update and draw times
+    void writeSummary(std::ostream &out) const;
+};
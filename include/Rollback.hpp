@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <vector>
+#include "Inputs.hpp"
+#include "Scenes/Scene.hpp"
+
+// Two player session without waiting for the other player: ticks run with a prediction of the remote inputs,
+// and when the real ones differ the scene is restored from the snapshot of that tick and simulated again.
+class Rollback
+{
+public:
+    static constexpr uint32_t NB_SNAPSHOTS = 64;
+    // Ticks simulated past the last remote input before waiting for the other player
+    static constexpr uint32_t MAX_PREDICTED = 16;
+    static constexpr uint8_t MAX_PACKET_INPUTS = 16;
+    static constexpr uint32_t PACKET_MAGIC = 0x42525344; // "DSRB"
+
+    struct Packet
+    {
+        uint32_t magic;
+        uint32_t tick; // Next tick the sender simulates
+        uint32_t firstTick; // Of the inputs
+        uint32_t ack; // Number of ticks received in a row from the other player
+        uint32_t hashTick; // Last tick simulated with real inputs only, plus one
+        uint64_t hash;
+        uint8_t nbInputs;
+        struct
+        {
+            int16_t x, y;
+            uint8_t buttons;
+        } inputs[MAX_PACKET_INPUTS];
+    };
+
+    class Link
+    {
+    public:
+        virtual ~Link() {}
+        virtual void send(const Packet &packet) = 0;
+        virtual bool receive(Packet &packet) = 0;
+    };
+
+    struct Stats
+    {
+        uint32_t nbRollbacks = 0, maxDepth = 0;
+        uint64_t totalDepth = 0;
+        int64_t lastResimTime = 0, maxResimTime = 0, totalResimTime = 0; // ns
+        uint32_t nbWaits = 0; // Ticks waiting for the other player, too far behind
+        uint32_t nbSkips = 0; // Ticks given up to let the other player catch up
+        uint32_t nbChecks = 0, nbDesyncs = 0, firstDesync = 0;
+    };
+
+private:
+    Link &link;
+    Scene *scene = nullptr;
+    size_t stateSize = 0;
+    bool connected = false;
+
+    // State before each tick, one allocation for the whole ring
+    std::vector<uint8_t> snapshots;
+    std::array<Inputs::State, NB_SNAPSHOTS> localInputs, remoteInputs, usedRemoteInputs;
+    // Hash of the state after each tick
+    std::array<uint64_t, NB_SNAPSHOTS> hashes;
+    uint32_t currentTick = 0; // Next tick to simulate
+    uint32_t remoteTick = 0; // Next tick without a remote input
+    uint32_t firstTick = 0; // Of the current scene, earlier snapshots belong to another one
+    uint32_t peerAck = 0;
+    int32_t peerAdvantage = 0; // Ticks the other player runs ahead of our inputs
+    uint32_t nextSkipTick = 0;
+    uint32_t rollbackTick = UINT32_MAX;
+    uint32_t remoteHashTick = 0, checkedHashTick = 0;
+    uint64_t remoteHash = 0;
+    Stats stats;
+
+    void reset(Scene &scene);
+    void receive();
+    void send();
+    void simulate(Scene &scene, uint64_t microseconds);
+    void checkHash();
+    Inputs::State getRemoteInputs(uint32_t tick) const;
+
+public:
+    Rollback(Link &link);
+    // Receives the remote inputs and simulates again the ticks they change, call before the ticks of each frame
+    void poll(Scene &scene, uint64_t microseconds);
+    // Replaces scene.update for a real tick
+    void tick(Scene &scene, uint64_t microseconds, Inputs::State inputs);
+    bool isConnected() const;
+    uint32_t getTick() const;
+    uint32_t getRemoteTick() const;
+    // Hash of the state after the given tick, while it is in the ring
+    uint64_t getHash(uint32_t tick) const;
+    const Stats& getStats() const;
+    // Both players' inputs, in an order that doesn't matter so both instances see the same
+    static Inputs::State merge(Inputs::State a, Inputs::State b);
+};
@@ -1,20 +1,37 @@
 #pragma once
 
+#include <array>
 #include "Scenes/Scene.hpp"
 
 class AccurateInputLag : public Scene
 {
 private:
+    static constexpr uint8_t MAX_LAG_TICKS = 15;
+    static constexpr uint8_t NB_RUN_AHEAD = 5;
+
     struct State
     {
         bool display = false;
+        uint16_t history = 0; // Bit i is set when the input was pressed i ticks ago
+        uint16_t pressId = 0, ticksSincePress = 0, resets = 0;
         uint64_t time = 0;
         uint32_t totalFrames0 = 0, totalFrames1 = 0;
         uint16_t presses = 0;
+        uint64_t totalPressAge = 0;
         float lastInputLag0 = 0, lastInputLag1 = 0;
     };
     State cur, saved;
 
+    // Settings
+    int lagTicks = 0; // The press is only shown that many ticks after it was sampled, like the lag built into games
+    uint8_t runAhead = 0;
+
+    // Real ticks between a press and the first frame drawn showing it, for each run-ahead
+    std::array<uint32_t, NB_RUN_AHEAD> visibleTicks, visiblePresses;
+    uint16_t lastShownPress = 0, lastReset = 0;
+
+    void draw(const State &state);
+
 public:
     AccurateInputLag();
     void displayImGuiSettings() override;
@@ -22,5 +39,12 @@ public:
     void saveState() override;
     void loadState() override;
     void draw() override;
+    size_t getStateSize() const override;
+    void copyState(void *to) const override;
+    void drawState(const void *state) override;
+    void restoreState(const void *from) override;
+    uint64_t hashState() const override;
     std::pair<float, float> getInputLags() const;
+    // Ticks the drawn state is ahead of the real one, for the visible lag statistics
+    void setRunAhead(uint8_t ticks);
 };
@@ -1,6 +1,9 @@
+#pragma once
+
 #include <cstdint>
 #include <array>
 #include "Scenes/Scene.hpp"
+#include "Scenes/TickStates.hpp"
 
 class GhettoInputLag : public Scene
 {
@@ -12,14 +15,16 @@ private:
 
     struct State
     {
-        std::array<int64_t, NB_BEATS> diffs;
+        std::array<int64_t, NB_BEATS> diffs{}; // A beat not pressed keeps the diff of the measure before, or 0
         uint64_t time = 0;
         int32_t lag = 0;
         uint8_t beat = 0;
         bool prevInput = false;
     };
 
-    State cur, saved;
+    TickStates<State> states, saved;
+
+    void draw(const State &state);
     
 public:
     GhettoInputLag();
@@ -28,4 +33,10 @@ public:
     void saveState() override;
     void loadState() override;
     void draw();
+    void drawInterpolated(float alpha) override;
+    size_t getStateSize() const override;
+    void copyState(void *to) const override;
+    void drawState(const void *state) override;
+    void restoreState(const void *from) override;
+    uint64_t hashState() const override;
 };
\ No newline at end of file
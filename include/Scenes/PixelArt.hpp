@@ -1,15 +1,21 @@
 #pragma once
 
-#include <GL/glew.h>
 #include "Scenes/Scene.hpp"
+#include "TextureLoader.hpp"
 
 class PixelArt : public Scene
 {
 private:
-    GLuint texture;
+    static constexpr int TILE_SIZE = 16;
+    static constexpr int MAX_SPRITES = 100000;
+
+    TextureLoader::Handle map = -1;
+    // Tiles of the map drawn over it, as many sprites
+    int nbSprites = 0;
 
 public:
     PixelArt();
     void init();
+    void displayImGuiSettings() override;
     void draw() override;
 };
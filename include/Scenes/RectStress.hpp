@@ -0,0 +1,24 @@
+#pragma once
+
+#include "Scenes/Scene.hpp"
+
+// Lots of small colored rects, to compare the instanced batch with one clear per rect
+class RectStress : public Scene
+{
+private:
+    static constexpr int MIN_RECTS = 10000;
+    static constexpr int MAX_RECTS = 1000000;
+
+    int nbRects = MIN_RECTS;
+    bool useClears = false;
+    uint32_t frame = 0;
+
+    // Moving averages, µs
+    float submitTime = 0, flushTime = 0, frameTime = 0;
+    int64_t lastDrawTime = 0;
+
+public:
+    RectStress();
+    void displayImGuiSettings() override;
+    void draw() override;
+};
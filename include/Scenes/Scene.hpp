@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstdint>
+#include <cstddef>
 #include "Inputs.hpp"
 
 class Scene
@@ -15,4 +16,15 @@ public:
     virtual void saveState() {};
     virtual void loadState() {};
     virtual void draw() {};
+    // Draws the state alpha of the way from the previous tick to the current one
+    virtual void drawInterpolated(float alpha) { draw(); };
+    // Plain copy of the state, so another thread can draw it while the updates go on
+    virtual size_t getStateSize() const { return 0; }
+    virtual void copyState(void *to) const {};
+    // Draws a copy made by copyState instead of the current state
+    virtual void drawState(const void *state) { draw(); };
+    // Puts back a copy made by copyState
+    virtual void restoreState(const void *from) {};
+    // Hash of the fields only, copies also carry the padding
+    virtual uint64_t hashState() const { return 0; };
 };
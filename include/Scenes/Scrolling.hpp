@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Scenes/Scene.hpp"
+#include "Scenes/TickStates.hpp"
 
 class Scrolling : public Scene
 {
@@ -12,7 +13,9 @@ private:
         int64_t scrollX = 0, scrollY = 0; //  >> 16
     };
 
-    State cur, saved;
+    TickStates<State> states, saved;
+
+    void draw(const State &state);
 
     static constexpr uint8_t SQUARES_SIZE = 128;
 
@@ -23,4 +26,10 @@ public:
     void loadState() override;
     void displayImGuiSettings() override;
     void draw() override;
+    void drawInterpolated(float alpha) override;
+    size_t getStateSize() const override;
+    void copyState(void *to) const override;
+    void drawState(const void *state) override;
+    void restoreState(const void *from) override;
+    uint64_t hashState() const override;
 };
@@ -0,0 +1,22 @@
+#pragma once
+
+// The states after the last two ticks. Frames between ticks blend them instead of simulating a partial tick.
+template<typename State>
+class TickStates
+{
+public:
+    State prev, cur;
+
+    // At the start of each tick, before changing cur
+    void beginTick()
+    {
+        prev = cur;
+    }
+
+    template<typename T>
+    static T blend(T from, T to, float alpha)
+    {
+        // In double, so counters going down blend too
+        return static_cast<T>(static_cast<double>(from) + (static_cast<double>(to) - static_cast<double>(from)) * alpha);
+    }
+};
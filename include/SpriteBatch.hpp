@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <GL/glew.h>
+#include "Renderer.hpp"
+#include "imgui/imstb_rectpack.h"
+
+// Images packed into atlas pages, drawn as textured quads batched per page.
+// Each page is drawn in one call, so quads on different pages don't keep their relative order.
+class SpriteBatch
+{
+public:
+    static constexpr int PAGE_SIZE = 2048;
+    static constexpr int PADDING = 1;
+
+    enum Flip : uint8_t
+    {
+        noFlip = 0,
+        horizontal = 1,
+        vertical = 2
+    };
+
+private:
+    struct Instance
+    {
+        int16_t x0, y0, x1, y1;
+        int16_t u0, v0, u1, v1; // Texels in the page
+        Renderer::Color color;
+    };
+
+    struct Page
+    {
+        GLuint texture;
+        GLenum format; // Compressed pages are packed in blocks
+        stbrp_context context;
+        std::vector<stbrp_node> nodes;
+        std::vector<Instance> instances;
+    };
+
+    struct Sprite
+    {
+        uint16_t page;
+        int16_t x, y, w, h;
+    };
+
+    // Pointers, the pack context points into itself
+    std::vector<std::unique_ptr<Page>> pages;
+    std::vector<Sprite> sprites;
+    GLuint program = 0, vao = 0, rectAttrib = 0, texRectAttrib = 0, colorAttrib = 0;
+    uint32_t nbQueued = 0;
+    uint32_t frameDrawCalls = 0, frameQuads = 0, nbDrawCalls = 0, nbDrawnQuads = 0;
+
+    Page& addPage(GLenum format);
+
+public:
+    // Needs instanced arrays
+    void init();
+    // Room in a page of that format for a sprite, without pixels yet.
+    // Returns the sprite id, -1 if it can't fit in a page.
+    int reserve(int w, int h, GLenum format = GL_SRGB8_ALPHA8);
+    // RGBA pixels, first row first, or their offset in the bound GL_PIXEL_UNPACK_BUFFER
+    void upload(int sprite, const uint8_t *pixels, int pitch);
+    // 4x4 blocks of the page's format covering the sprite, the same way
+    void uploadCompressed(int sprite, const uint8_t *blocks, size_t size);
+    int add(const uint8_t *pixels, int w, int h, int pitch);
+    int load(const char *path);
+    // Whole sprite, or the sub-rect in its pixels. The first row is drawn at y0.
+    void draw(int sprite, int16_t x0, int16_t y0, int16_t x1, int16_t y1,
+            Renderer::Color color = Renderer::WHITE, uint8_t flip = noFlip);
+    void draw(int sprite, int16_t srcX, int16_t srcY, int16_t srcW, int16_t srcH, int16_t x0, int16_t y0, int16_t x1,
+            int16_t y1, Renderer::Color color = Renderer::WHITE, uint8_t flip = noFlip);
+    // One draw call per page with queued quads
+    void flush();
+    bool isEmpty() const;
+    size_t getNbPages() const;
+    // Flushes and keeps the frame's counts
+    void endFrame();
+    uint32_t getNbDrawCalls() const;
+    uint32_t getNbDrawnQuads() const;
+};
+
+extern SpriteBatch spriteBatch;
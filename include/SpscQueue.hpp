@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <array>
+
+// Wait-free queue between exactly one producer thread and one consumer thread.
+// Both push and pop return immediately, push fails when the queue is full.
+template<typename T, uint32_t N>
+class SpscQueue
+{
+private:
+    static_assert(N && !(N & (N - 1)), "N must be a power of two");
+
+    std::array<T, N> items;
+    // On separate cache lines, so the two threads don't invalidate each other's index
+    alignas(64) std::atomic<uint32_t> writeIndex;
+    alignas(64) std::atomic<uint32_t> readIndex;
+
+public:
+    SpscQueue() : writeIndex(0), readIndex(0)
+    {
+    }
+
+    bool push(const T &item)
+    {
+        uint32_t write = writeIndex.load(std::memory_order_relaxed);
+        if(write - readIndex.load(std::memory_order_acquire) >= N) return false;
+        items[write & (N - 1)] = item;
+        writeIndex.store(write + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &item)
+    {
+        uint32_t read = readIndex.load(std::memory_order_relaxed);
+        if(read == writeIndex.load(std::memory_order_acquire)) return false;
+        item = items[read & (N - 1)];
+        readIndex.store(read + 1, std::memory_order_release);
+        return true;
+    }
+};
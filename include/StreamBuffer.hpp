@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <GL/glew.h>
+
+// Vertex, index or pixel data written each frame for the next draws or uploads, in one buffer split in regions used
+// in turn. With ARB_buffer_storage the buffer stays mapped and a fence tells when the GPU is done with a region,
+// otherwise it is orphaned when full and written through unsynchronized maps. One per context using it.
+class StreamBuffer
+{
+public:
+    static constexpr uint8_t NB_REGIONS = 3;
+
+private:
+    GLuint buffer = 0;
+    GLenum target = GL_ARRAY_BUFFER;
+    uint8_t *mapping = nullptr; // Whole buffer, while persistent
+    bool persistent = false;
+    size_t regionSize = 0;
+    uint8_t region = 0;
+    size_t pos = 0, regionStart = 0;
+    GLsync fences[NB_REGIONS] = {};
+    size_t frameBytes = 0, lastFrameBytes = 0;
+    int64_t frameWaitTime = 0, lastWaitTime = 0; // ns
+
+    void create(size_t regionSize);
+    void nextRegion();
+
+public:
+    // Needs the context current, and ends each frame with it
+    void init(size_t regionSize, GLenum target = GL_ARRAY_BUFFER);
+    void destroy();
+    // Room for size bytes, and their offset in the buffer. Grows the buffer, a new one, when too small.
+    // Leaves the buffer bound to its target, and it must be unmapped before drawing.
+    uint8_t* map(size_t size, size_t alignment, GLintptr &offset);
+    void unmap();
+    GLintptr write(const void *data, size_t size, size_t alignment);
+    // Fences the region read by this frame's draws and moves to the next one
+    void endFrame();
+    GLuint getBuffer() const;
+    bool isPersistent() const;
+    size_t getSize() const;
+    size_t getFrameBytes() const;
+    // Waiting for the GPU to release a region during the last frame, ns
+    int64_t getWaitTime() const;
+};
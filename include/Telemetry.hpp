@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Timestamps of every phase of every frame, recorded without locks nor allocations into a ring buffer.
+// A background thread drains it to <path>.bin and to <path>.json, a Chrome trace-event file that can be opened in
+// chrome://tracing or Perfetto.
+// The .bin file is a FileHeader followed by Event records, in the native byte order. GPU phases go to their own track.
+class Telemetry
+{
+public:
+    enum Phase : uint8_t
+    {
+        events,
+        imGui,
+        frameDelay,
+        update,
+        sceneDraw,
+        windowDraw,
+        swap,
+        gpuHardSync,
+        runAhead,
+        rollback,
+        // Read back from the GPU frames later, on the GPU's timeline
+        gpuLongDraw,
+        gpuSceneDraw,
+        gpuWindowDraw,
+        gpuImGui
+    };
+
+    static const char phaseNames[Phase::gpuImGui + 1][16];
+
+    struct Event
+    {
+        int64_t start, end; // ns
+        uint32_t frame;
+        Phase phase;
+    };
+
+    struct FileHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t eventSize;
+    };
+
+    // Records the time spent in the enclosing block
+    class Scope
+    {
+    private:
+        Phase phase;
+        int64_t start;
+
+    public:
+        Scope(Phase phase);
+        ~Scope();
+    };
+
+private:
+    static constexpr uint32_t RING_SIZE = 1 << 16; // Power of two
+    static constexpr int FLUSH_PERIOD = 50; // ms
+
+    std::vector<Event> ring;
+    std::atomic<uint32_t> writeIndex, readIndex;
+    std::atomic<bool> running;
+    std::atomic<uint32_t> dropped;
+    uint32_t frame = 0;
+    bool firstJsonEvent = true;
+    FILE *binFile = nullptr, *jsonFile = nullptr;
+    std::thread flushThread;
+
+    void flush();
+    void flushLoop();
+
+public:
+    Telemetry();
+    ~Telemetry();
+    bool start(const char *path);
+    void stop();
+    bool isRecording() const;
+    void beginFrame();
+    void record(Phase phase, int64_t start, int64_t end);
+    // For an earlier frame
+    void record(Phase phase, int64_t start, int64_t end, uint32_t frame);
+    uint32_t getFrame() const;
+    uint32_t getNbDropped() const;
+};
+
+extern Telemetry telemetry;
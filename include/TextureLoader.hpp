@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <SDL2/SDL.h>
+#include <GL/glew.h>
+#include "StreamBuffer.hpp"
+#include "AssetPack.hpp"
+
+// Images decoded by worker threads, then copied to pixel buffers and uploaded by the render context a few per frame,
+// so neither the start nor a scene loading more stalls on a decode or a synchronous upload.
+// Images in the asset pack skip the decode, their pixels are copied from its mapping, compressed when the pack has them
+// in a format the driver supports.
+class TextureLoader
+{
+public:
+    enum State : uint8_t
+    {
+        pending,
+        ready,
+        failed
+    };
+
+    enum Target : uint8_t
+    {
+        texture,
+        sprite // In the sprite batch
+    };
+
+    typedef int Handle;
+
+    static constexpr size_t UPLOAD_BUDGET = 8 << 20; // Bytes per frame, past the first image
+    static constexpr unsigned MAX_WORKERS = 4;
+
+    struct Stats
+    {
+        uint32_t nbLoaded = 0, nbFromPack = 0;
+        int64_t decodeTime = 0; // Spent by the workers, ns
+        size_t uploadedBytes = 0, rgbaBytes = 0; // The second as if they all were RGBA
+        int64_t firstStart = 0, lastReady = 0; // ns
+    };
+
+private:
+    struct Request
+    {
+        std::string path;
+        Target target;
+        State state;
+        SDL_Surface *surface; // Decoded, freed once uploaded
+        const uint8_t *pixels; // RGBA or blocks, from the surface or the pack
+        AssetPack::Format format;
+        int w, h, pitch;
+        size_t size; // Copied to the pixel buffer
+        int id; // Texture or sprite
+        int64_t start, readyTime; // ns
+        bool fromPack;
+    };
+
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    std::vector<std::thread> workers;
+    bool stopping = false;
+    // References stay valid as it grows
+    std::deque<Request> requests;
+    std::deque<Request*> toDecode, toUpload;
+    StreamBuffer uploads;
+    AssetPack pack;
+    bool packOpened = false;
+    Stats stats;
+
+    void decode();
+    void upload(Request &request);
+    // With the mutex held
+    bool isValid(Handle handle) const;
+
+public:
+    bool usePack = true;
+    bool useCompression = true;
+    std::string packPath = "assets/textures.pack";
+
+    ~TextureLoader();
+    Handle load(const char *path, Target target);
+    // With the render context current, once per frame
+    void update();
+    // Unknown handles read as failed, with an id of -1 and no time, format or bytes
+    State getState(Handle handle);
+    // GL texture or sprite id, once ready
+    int getId(Handle handle);
+    // From the request to the upload, ns
+    int64_t getLoadTime(Handle handle);
+    uint32_t getNbPending();
+    bool isFromPack(Handle handle);
+    AssetPack::Format getFormat(Handle handle);
+    // Uploaded, and as RGBA
+    size_t getBytes(Handle handle);
+    size_t getRgbaBytes(Handle handle);
+    Stats getStats();
+};
+
+extern TextureLoader textureLoader;
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+
+// Process-wide monotonic time, with a backend chosen at startup.
+// The TSC backend reads the CPU timestamp counter, calibrated against CLOCK_MONOTONIC,
+// which avoids a vDSO call on each read in spin loops.
+class TimeSource
+{
+public:
+    enum Backend : int8_t
+    {
+        monotonic,
+        monotonicRaw,
+        tsc
+    };
+
+    static const char backendNames[Backend::tsc + 1][16];
+
+private:
+    static Backend backend;
+    static int64_t tscBase, nsBase;
+    static double nsPerTick;
+
+    static int64_t readBackend(Backend backend);
+    static void calibrateTsc();
+
+public:
+    static bool isAvailable(Backend backend);
+    static bool select(Backend backend);
+    static Backend getBackend();
+    static int64_t getTimeNanoseconds();
+    static int64_t getTimeMicroseconds();
+    // Convert a time of the selected backend to CLOCK_MONOTONIC, which OS timers use
+    static int64_t toMonotonicNanoseconds(int64_t nanoseconds);
+    // And back, for timestamps given by the OS
+    static int64_t fromMonotonicNanoseconds(int64_t nanoseconds);
+    // Read cost of each available backend and drift against CLOCK_MONOTONIC
+    static void runBenchmark(std::ostream &out);
+};
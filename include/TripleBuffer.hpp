@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <array>
+
+// Hands the latest value from one writer thread to one reader thread without locks.
+// The writer and the reader each own a buffer, the third one is exchanged between them.
+template<typename T>
+class TripleBuffer
+{
+private:
+    static constexpr uint8_t FRESH = 4; // The exchanged buffer was published since the reader last took it
+
+    std::array<T, 3> buffers;
+    std::atomic<uint8_t> middle;
+    uint8_t writeIndex = 0, readIndex = 1;
+
+public:
+    TripleBuffer() : middle(2)
+    {
+    }
+
+    // Writer side
+    T& getWriteBuffer()
+    {
+        return buffers[writeIndex];
+    }
+
+    void publish()
+    {
+        writeIndex = middle.exchange(writeIndex | FRESH, std::memory_order_acq_rel) & (FRESH - 1);
+    }
+
+    // Reader side, returns whether a newer buffer was taken
+    bool update()
+    {
+        if(!(middle.load(std::memory_order_relaxed) & FRESH)) return false;
+        readIndex = middle.exchange(readIndex, std::memory_order_acq_rel) & (FRESH - 1);
+        return true;
+    }
+
+    const T& getReadBuffer() const
+    {
+        return buffers[readIndex];
+    }
+};
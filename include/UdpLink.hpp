@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include "Rollback.hpp"
+
+// Rollback packets between two instances on this machine, over non-blocking UDP
+class UdpLink : public Rollback::Link
+{
+private:
+    struct DelayedPacket
+    {
+        int64_t time; // µs
+        Rollback::Packet packet;
+    };
+
+    intptr_t sock = -1;
+    uint16_t remotePort = 0;
+    // Added to the loopback latency, so there is something to roll back
+    int latency = 0; // µs
+    std::deque<DelayedPacket> delayed;
+    uint32_t nbSent = 0, nbReceived = 0;
+
+    void sendDue();
+
+public:
+    ~UdpLink();
+    bool open(uint16_t localPort, uint16_t remotePort);
+    void close();
+    void setLatency(int microseconds);
+    void send(const Rollback::Packet &packet) override;
+    bool receive(Rollback::Packet &packet) override;
+    uint32_t getNbSent() const;
+    uint32_t getNbReceived() const;
+};
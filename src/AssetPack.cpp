@@ -0,0 +1,83 @@
+#include <iostream>
+#include <cstring>
+#include "AssetPack.hpp"
+
+constexpr char AssetPack::MAGIC[4];
+constexpr uint32_t AssetPack::VERSION;
+constexpr size_t AssetPack::NAME_SIZE;
+constexpr size_t AssetPack::DATA_ALIGNMENT;
+
+const char AssetPack::formatNames[Format::etc2 + 1][8] =
+{
+    "RGBA8",
+    "BC1",
+    "BC3",
+    "BC7",
+    "ETC2"
+};
+
+size_t AssetPack::getDataSize(Format format, int w, int h)
+{
+    if(format == rgba8) return static_cast<size_t>(w) * h * 4;
+    size_t nbBlocks = static_cast<size_t>((w + 3) / 4) * ((h + 3) / 4);
+    return nbBlocks * (format == bc1 ? 8 : 16);
+}
+
+bool AssetPack::open(const char *path)
+{
+    close();
+    if(!file.open(path)) return false;
+    Header header;
+    if(file.getSize() < sizeof(header))
+    {
+        close();
+        return false;
+    }
+    memcpy(&header, file.getData(), sizeof(header));
+    if(memcmp(header.magic, MAGIC, sizeof(MAGIC)) || header.version != VERSION
+            || file.getSize() < sizeof(header) + header.nbEntries * sizeof(Entry))
+    {
+        std::cerr << path << " isn't a pack of this version, loading the images instead" << std::endl;
+        close();
+        return false;
+    }
+    entries = reinterpret_cast<const Entry*>(file.getData() + sizeof(header));
+    nbEntries = header.nbEntries;
+    for(uint32_t i = 0; i < nbEntries; i++)
+    {
+        const Entry &entry = entries[i];
+        if(entry.offset + entry.size > file.getSize() || !memchr(entry.name, 0, NAME_SIZE) || entry.format > etc2
+                || entry.size < getDataSize(static_cast<Format>(entry.format), entry.w, entry.h))
+        {
+            std::cerr << path << " is damaged, loading the images instead" << std::endl;
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+void AssetPack::close()
+{
+    file.close();
+    entries = nullptr;
+    nbEntries = 0;
+}
+
+bool AssetPack::isOpen() const
+{
+    return entries != nullptr;
+}
+
+const AssetPack::Entry* AssetPack::find(const char *name, Format format) const
+{
+    // A handful of entries, looked up once per image
+    for(uint32_t i = 0; i < nbEntries; i++)
+        if(entries[i].format == format && !strcmp(entries[i].name, name)) return &entries[i];
+    return nullptr;
+}
+
+const uint8_t* AssetPack::getData(const Entry &entry) const
+{
+    return file.getData() + entry.offset;
+}
@@ -1,5 +1,6 @@
 #include <iostream>
 #include <algorithm>
+#include <initializer_list>
 #include <SDL2/SDL_syswm.h>
 #include "DisplayWindow.hpp"
 #include "Renderer.hpp"
@@ -67,11 +68,79 @@ void DisplayWindow::create()
     }
     sdlWindow = SDL_CreateWindow("SDL test", posX, posY, sizeX, sizeY, flags);
     if(windowMode == fullscreen) SDL_SetWindowDisplayMode(sdlWindow, &dm);
-    context = SDL_GL_CreateContext(sdlWindow);
-    SDL_GL_MakeCurrent(sdlWindow, context);
+    // The context outlives the windows, it only needs a new one when the new window's pixel format doesn't fit
+    if(!context || SDL_GL_MakeCurrent(sdlWindow, context))
+    {
+        if(context) SDL_GL_DeleteContext(context);
+        context = SDL_GL_CreateContext(sdlWindow);
+        SDL_GL_MakeCurrent(sdlWindow, context);
+        gl.invalidate();
+        gpuTimer.init();
+        glEnable(GL_FRAMEBUFFER_SRGB);
+        // Shared with the renderer's context, so made once
+        if(!vbo) loadPrograms();
+        createVertexArrays();
+        {
+            int32_t err=glGetError();
+            if(err)
+                std::cerr << "Error window render " << gluErrorString(err) << std::endl;
+        }
+    }
+    setScalingFilter(scalingFilter);
+
+    // Get avaiable sync modes
+    if(SDL_GL_SetSwapInterval(-1) == 0) canAdaptiveSync = true;
+    if(SDL_GL_GetSwapInterval() != -1) canAdaptiveSync = false;
+    if(SDL_GL_SetSwapInterval(0) == 0) canNoVSync = true;
+    if(SDL_GL_GetSwapInterval() != 0) canNoVSync = false;
+    if(SDL_GL_SetSwapInterval(1) == 0) canVSync = true;
+    if(SDL_GL_GetSwapInterval() != 1) canVSync = false;
+
+    // Detecting a triple buffer takes four synced swaps and a read back, once per mode
+    std::tuple<int8_t, int, int> mode(windowMode, windowMode == windowed ? 0 : fullscreenDisplay,
+            windowMode == fullscreen ? displayMode : 0);
+    auto detected = tripleBufferModes.find(mode);
+    if(detected != tripleBufferModes.end()) tripleBuffer = detected->second;
+    else
+    {
+        gl.clearColor(0, 0, 0, 0);
+        glClear(GL_COLOR_BUFFER_BIT);
+        SDL_GL_SwapWindow(sdlWindow);
+        gl.clearColor(0.1f, 0, 0, 0);
+        glClear(GL_COLOR_BUFFER_BIT);
+        SDL_GL_SwapWindow(sdlWindow);
+        gl.clearColor(0, 0.1f, 0, 0);
+        glClear(GL_COLOR_BUFFER_BIT);
+        SDL_GL_SwapWindow(sdlWindow);
+        gl.clearColor(0, 0, 0.1f, 0);
+        glClear(GL_COLOR_BUFFER_BIT);
+        SDL_GL_SwapWindow(sdlWindow);
+        uint8_t col[3];
+        glReadPixels(0, 0, 1, 1, GL_RGB, GL_UNSIGNED_BYTE, col);
+        tripleBuffer = col[1] == 0;
+        tripleBufferModes[mode] = tripleBuffer;
+    }
+    if(!isSyncModeAvailable(syncMode))
+    {
+        int i = 0;
+        while(!isSyncModeAvailable(static_cast<SyncMode>(i))) i++;
+        syncMode = static_cast<SyncMode>(i);
+    }
+    setSyncMode(syncMode);
+
+    // Init ImGui, its GL objects are kept along with the context
+    if(!ImGui::GetCurrentContext())
+    {
+        ImGui::CreateContext();
+        //ImGuiIO& io = ImGui::GetIO();
+        ImGui_ImplOpenGL3_Init("#version 150");
+        ImGui::StyleColorsDark();
+    }
+    ImGui_ImplSDL2_InitForOpenGL(sdlWindow, context);
+}
 
-    // Init rendering
-    glEnable(GL_FRAMEBUFFER_SRGB);
+void DisplayWindow::loadPrograms()
+{
     glGenBuffers(1, &vbo);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
     {
@@ -84,23 +153,13 @@ void DisplayWindow::create()
         };
         glBufferData(GL_ARRAY_BUFFER, 16 * 4, data, GL_STATIC_DRAW);
     }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
     auto loadProgram = [this](ProgramIds &programIds, const char *vert, const char *frag)
     {
         programIds.program = Renderer::loadShaders(vert, frag);
-        glUseProgram(programIds.program);
+        gl.useProgram(programIds.program);
         glUniform1i(glGetUniformLocation(programIds.program, "tex"), 0);
-        glGenVertexArrays(1, &programIds.vao);
-        glBindVertexArray(programIds.vao);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        {
-            GLuint attrib = glGetAttribLocation(programIds.program, "pos");
-            glVertexAttribPointer(attrib, 2, GL_FLOAT, false, 16, (void*)0);
-            glEnableVertexAttribArray(attrib);
-            attrib = glGetAttribLocation(programIds.program, "textureCoord");
-            glVertexAttribPointer(attrib, 2, GL_FLOAT, false, 16, (void*)8);
-            glEnableVertexAttribArray(attrib);
-            glBindFragDataLocation(programIds.program, 0, "fragColor");
-        }
+        glBindFragDataLocation(programIds.program, 0, "fragColor");
     };
     loadProgram(bilinearProgram, "assets/basic_texture.vert", "assets/tunable_bilinear.frag");
     glUniform2i(glGetUniformLocation(bilinearProgram.program, "sourceSize"), NATIVE_RES_X, NATIVE_RES_Y);
@@ -115,54 +174,25 @@ void DisplayWindow::create()
     bcUniform = glGetUniformLocation(bicubicProgram.program, "bc");
     loadProgram(lanczos3Program, "assets/basic_texture.vert", "assets/lanczos3.frag");
     glUniform2i(glGetUniformLocation(lanczos3Program.program, "sourceSize"), NATIVE_RES_X, NATIVE_RES_Y);
-    setScalingFilter(bilinear);
-
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-    {
-        int32_t err=glGetError();
-        if(err)
-            std::cerr << "Error window render " << gluErrorString(err) << std::endl;
-    }
-
-    // Get avaiable sync modes
-    if(SDL_GL_SetSwapInterval(-1) == 0) canAdaptiveSync = true;
-    if(SDL_GL_GetSwapInterval() != -1) canAdaptiveSync = false;
-    if(SDL_GL_SetSwapInterval(0) == 0) canNoVSync = true;
-    if(SDL_GL_GetSwapInterval() != 0) canNoVSync = false;
-    if(SDL_GL_SetSwapInterval(1) == 0) canVSync = true;
-    if(SDL_GL_GetSwapInterval() != 1) canVSync = false;
+}
 
-    // Detect triple buffer
-    glClearColor(0, 0, 0, 0);
-    glClear(GL_COLOR_BUFFER_BIT);
-    SDL_GL_SwapWindow(sdlWindow);
-    glClearColor(0.1f, 0, 0, 0);
-    glClear(GL_COLOR_BUFFER_BIT);
-    SDL_GL_SwapWindow(sdlWindow);
-    glClearColor(0, 0.1f, 0, 0);
-    glClear(GL_COLOR_BUFFER_BIT);
-    SDL_GL_SwapWindow(sdlWindow);
-    glClearColor(0, 0, 0.1f, 0);
-    glClear(GL_COLOR_BUFFER_BIT);
-    SDL_GL_SwapWindow(sdlWindow);
-    uint8_t col[3];
-    glReadPixels(0, 0, 1, 1, GL_RGB, GL_UNSIGNED_BYTE, col);
-    tripleBuffer = col[1] == 0;
-    if(!isSyncModeAvailable(syncMode))
+void DisplayWindow::createVertexArrays()
+{
+    // Not shared between contexts
+    for(ProgramIds *programIds : {&bilinearProgram, &pixelAverageProgram, &bicubicProgram, &lanczos3Program})
     {
-        int i = 0;
-        while(!isSyncModeAvailable(static_cast<SyncMode>(i))) i++;
-        syncMode = static_cast<SyncMode>(i);
+        glGenVertexArrays(1, &programIds->vao);
+        gl.bindVertexArray(programIds->vao);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        GLuint attrib = glGetAttribLocation(programIds->program, "pos");
+        glVertexAttribPointer(attrib, 2, GL_FLOAT, false, 16, (void*)0);
+        glEnableVertexAttribArray(attrib);
+        attrib = glGetAttribLocation(programIds->program, "textureCoord");
+        glVertexAttribPointer(attrib, 2, GL_FLOAT, false, 16, (void*)8);
+        glEnableVertexAttribArray(attrib);
     }
-    setSyncMode(syncMode);
-
-    // Init ImGui
-    ImGui::CreateContext();
-    //ImGuiIO& io = ImGui::GetIO();
-    ImGui_ImplSDL2_InitForOpenGL(sdlWindow, context);
-    ImGui_ImplOpenGL3_Init("#version 150");
-    ImGui::StyleColorsDark();
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    gl.bindVertexArray(0);
 }
 
 void DisplayWindow::useContext()
@@ -223,16 +253,16 @@ void DisplayWindow::setScalingFilter(ScalingFilter filter)
         case pixelAverage:
         case bicubic:
         case lanczos3:
-            glBindTexture(GL_TEXTURE_2D, renderer.texture);
+            gl.activeTexture(GL_TEXTURE0);
+            gl.bindTexture(renderer.texture);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-            glBindTexture(GL_TEXTURE_2D, 0);
             break;
         case bilinear:
-            glBindTexture(GL_TEXTURE_2D, renderer.texture);
+            gl.activeTexture(GL_TEXTURE0);
+            gl.bindTexture(renderer.texture);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glBindTexture(GL_TEXTURE_2D, 0);
             break;
     }
     scalingFilter = filter;
@@ -240,22 +270,22 @@ void DisplayWindow::setScalingFilter(ScalingFilter filter)
 
 void DisplayWindow::draw()
 {
-    glClearColor(0, 0, 0, 0);
+    gl.clearColor(0, 0, 0, 0);
     glClear(GL_COLOR_BUFFER_BIT);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, renderer.texture);
+    gl.activeTexture(GL_TEXTURE0);
+    gl.bindTexture(renderer.texture);
     switch(scalingFilter)
     {
         case bilinear:
-            glUseProgram(bilinearProgram.program);
-            glBindVertexArray(bilinearProgram.vao);
+            gl.useProgram(bilinearProgram.program);
+            gl.bindVertexArray(bilinearProgram.vao);
             glUniform1f(blurynessUniform, 1.f - sharpness * 0.01f);
             break;
         case pixelAverage:
         {
             int sizeX, sizeY;
-            glUseProgram(pixelAverageProgram.program);
-            glBindVertexArray(pixelAverageProgram.vao);
+            gl.useProgram(pixelAverageProgram.program);
+            gl.bindVertexArray(pixelAverageProgram.vao);
             SDL_GetWindowSize(sdlWindow, &sizeX, &sizeY);
             glUniform2i(windowSizeUniform, sizeX, sizeY);
             float mult = sharpness == 100 ? 1000000 : 0.5f / (1 - sharpness * 0.01f);
@@ -266,18 +296,16 @@ void DisplayWindow::draw()
             break;
         }
         case bicubic:
-            glUseProgram(bicubicProgram.program);
-            glBindVertexArray(bicubicProgram.vao);
+            gl.useProgram(bicubicProgram.program);
+            gl.bindVertexArray(bicubicProgram.vao);
             glUniform2f(bcUniform, 1.f - sharpness * 0.01f, sharpness * 0.005f);
             break;
         case lanczos3:
-            glUseProgram(lanczos3Program.program);
-            glBindVertexArray(lanczos3Program.vao);
+            gl.useProgram(lanczos3Program.program);
+            gl.bindVertexArray(lanczos3Program.vao);
             break;
     }
     glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-    glBindVertexArray(0);
-    glBindTexture(GL_TEXTURE_2D, 0);
     GLuint err = glGetError();
     if(err)
         std::cerr << "Error window render " << gluErrorString(err) << std::endl;
@@ -287,14 +315,14 @@ void DisplayWindow::swap()
 {
     //std::cout << SDL_GL_GetSwapInterval() << std::endl;
     //SDL_UpdateWindowSurface(sdlWindow);
+    gl.endFrame();
     SDL_GL_SwapWindow(sdlWindow);
     //SDL_UpdateWindowSurface(sdlWindow);
 }
 
 void DisplayWindow::destroy()
 {
-    ImGui_ImplOpenGL3_Shutdown();
+    // The context and ImGui are kept for the next window
     ImGui_ImplSDL2_Shutdown();
-    ImGui::DestroyContext();
     SDL_DestroyWindow(sdlWindow);
 }
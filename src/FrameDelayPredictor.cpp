@@ -0,0 +1,68 @@
+#include <algorithm>
+#include "FrameDelayPredictor.hpp"
+
+const char FrameDelayPredictor::costNames[Cost::total + 1][16] =
+{
+    "Update",
+    "Draw",
+    "Other",
+    "Total"
+};
+
+FrameDelayPredictor::FrameDelayPredictor()
+{
+    reset();
+}
+
+void FrameDelayPredictor::reset()
+{
+    for(std::array<int32_t, NB_FRAMES> &cost : costs) cost.fill(0);
+    nbFrames = 0;
+    currentFrame = 0;
+    margin = MIN_MARGIN;
+    predictedCost = 0;
+    nbMissedSyncs = 0;
+}
+
+void FrameDelayPredictor::addFrame(int64_t updateCost, int64_t drawCost, int64_t otherCost, bool missedSync)
+{
+    costs[Cost::update][currentFrame] = static_cast<int32_t>(updateCost);
+    costs[Cost::draw][currentFrame] = static_cast<int32_t>(drawCost);
+    costs[Cost::other][currentFrame] = static_cast<int32_t>(otherCost);
+    costs[Cost::total][currentFrame] = static_cast<int32_t>(updateCost + drawCost + otherCost);
+    ++currentFrame %= NB_FRAMES;
+    if(nbFrames < NB_FRAMES) nbFrames++;
+
+    if(missedSync)
+    {
+        nbMissedSyncs++;
+        margin = margin + MARGIN_STEP < MAX_MARGIN ? margin + MARGIN_STEP : MAX_MARGIN;
+    }
+    else margin = margin - MARGIN_DECAY > MIN_MARGIN ? margin - MARGIN_DECAY : MIN_MARGIN;
+    predictedCost = getPercentile(Cost::total, 1.f - missRate);
+}
+
+int64_t FrameDelayPredictor::getWaitTime(int64_t refreshPeriod) const
+{
+    if(nbFrames < MIN_FRAMES) return 0;
+    return std::max<int64_t>(refreshPeriod - predictedCost - margin, 0);
+}
+
+int64_t FrameDelayPredictor::getPercentile(Cost cost, float p) const
+{
+    if(nbFrames == 0) return 0;
+    std::array<int32_t, NB_FRAMES> sorted = costs[cost];
+    uint8_t index = static_cast<uint8_t>(std::min<float>(nbFrames * p, nbFrames - 1.f));
+    std::nth_element(sorted.begin(), sorted.begin() + index, sorted.begin() + nbFrames);
+    return sorted[index];
+}
+
+int64_t FrameDelayPredictor::getMargin() const
+{
+    return margin;
+}
+
+uint32_t FrameDelayPredictor::getNbMissedSyncs() const
+{
+    return nbMissedSyncs;
+}
@@ -0,0 +1,431 @@
+#include <algorithm>
+#include <cstdlib>
+#include "GameLoop.hpp"
+#include "TimeSource.hpp"
+#include "Telemetry.hpp"
+#include "Replay.hpp"
+
+const char GameLoop::inputLagMitigationNames[InputLagMitigation::frameDelay + 1][40] =
+{
+    "None",
+    "GPU hard sync",
+    "Predictive waiting"
+};
+
+const char GameLoop::timestepNames[Timestep::looseInterpolation + 1][40] =
+{
+    "Fixed",
+    "Interpolation",
+    "Loose",
+    "Loose + interpolation"
+};
+
+const char GameLoop::threadingNames[Threading::updateThread + 1][40] =
+{
+    "Single thread",
+    "Update thread"
+};
+
+GameLoop::GameLoop(Clock &clock, Display &display, InputSource &inputSource)
+    : clock(clock), display(display), inputSource(&inputSource), nbTicks(0), updaterRunning(false),
+      runAheadCost(0)
+{
+    startTime = prevUseconds = clock.getTimeMicroseconds();
+    frameTimes.fill(0);
+    iterationTimes.fill(0);
+}
+
+GameLoop::~GameLoop()
+{
+    stopUpdater();
+}
+
+void GameLoop::beginFrame()
+{
+    telemetry.beginFrame();
+
+    // Measure frame rate
+    startTime = clock.getTimeMicroseconds();
+    int64_t prevTime = frameTimes[currentFrame];
+    frameTimes[currentFrame] = startTime;
+    ++currentFrame %= frameTimes.size();
+    frameRate = static_cast<uint16_t>(frameTimes.size() * 1000000 / std::max<int64_t>(startTime - prevTime, 1));
+}
+
+void GameLoop::requestResync()
+{
+    resyncRequested = true;
+}
+
+void GameLoop::setInputSource(InputSource &inputSource)
+{
+    std::lock_guard<std::mutex> lock(updateMutex);
+    this->inputSource = &inputSource;
+}
+
+uint16_t GameLoop::getFrameRate() const
+{
+    return frameRate;
+}
+
+uint32_t GameLoop::getIterationTime() const
+{
+    uint32_t iterationTime = 0;
+    for(int64_t frameIterationTime : iterationTimes) iterationTime += static_cast<uint32_t>(frameIterationTime);
+    return iterationTime / static_cast<uint32_t>(iterationTimes.size());
+}
+
+bool GameLoop::hasMissedSync() const
+{
+    return missedSync;
+}
+
+uint32_t GameLoop::getNbTicks() const
+{
+    return nbTicks;
+}
+
+float GameLoop::getRunAheadCost() const
+{
+    return runAheadCost / 1000.f;
+}
+
+std::mutex& GameLoop::getUpdateMutex()
+{
+    return updateMutex;
+}
+
+Inputs::State GameLoop::nextInputs()
+{
+    if(!useSavedInputs) return inputSource->getState();
+    useSavedInputs = false;
+    return savedInputs;
+}
+
+Inputs::State GameLoop::heldInputs()
+{
+    // Inputs used to run ahead are kept for the next real tick,
+    // so the future drawn is the one that happens.
+    if(!useSavedInputs)
+    {
+        savedInputs = inputSource->getState();
+        useSavedInputs = true;
+    }
+    return savedInputs;
+}
+
+void GameLoop::tick(Scene &scene, int64_t microseconds, Inputs::State inputs)
+{
+    Telemetry::Scope scope(Telemetry::update);
+    if(replay) inputs = replay->beginTick(inputs);
+    if(rollback) rollback->tick(scene, static_cast<uint64_t>(microseconds / updateRate), inputs);
+    else scene.update(microseconds / updateRate, inputs);
+    if(replay) replay->endTick(scene, inputs);
+    nbTicks++;
+}
+
+void GameLoop::gpuHardSync()
+{
+    Telemetry::Scope scope(Telemetry::gpuHardSync);
+    display.gpuHardSync();
+}
+
+void GameLoop::runAheadTicks(Scene &scene, Inputs::State inputs, int nbTicks)
+{
+    // The caller restores the real state with loadState once the future one is drawn
+    int64_t start = TimeSource::getTimeNanoseconds();
+    for(int i = 0; i < nbTicks; i++) scene.update(1000000 / updateRate, inputs);
+    clock.spinUntil(clock.getTimeMicroseconds() + nbTicks
+            * (simulatedUpdateTime + (randomUpdateTime ? rand() % randomUpdateTime : 0)) * 100);
+    int64_t cost = (TimeSource::getTimeNanoseconds() - start) / nbTicks;
+    runAheadCost = static_cast<uint32_t>((static_cast<int64_t>(runAheadCost) * 15 + cost) / 16);
+}
+
+uint8_t GameLoop::updateScene(Scene &scene, int64_t dToUpdate)
+{
+    uint8_t nbFramesToUpdate = 0;
+    bool isLoose = timestep == Timestep::loose || timestep == Timestep::looseInterpolation;
+
+    // Whole ticks
+    if(rollback) rollback->poll(scene, 1000000 / updateRate);
+    while(toUpdate > 1000000)
+    {
+        tick(scene, 1000000 + (isLoose ? addToUpdate : 0), nextInputs());
+        if(isLoose) addToUpdate = 0;
+        toUpdate -= 1000000;
+        nbFramesToUpdate++;
+    }
+    scene.saveState();
+
+    // Remaining fraction of a tick
+    drawAlpha = 1.f;
+    switch(timestep)
+    {
+        case Timestep::fixed:
+            break;
+        case Timestep::interpolation:
+            // Drawn between the last two ticks, as far as the next one is due
+            if(toUpdate > 0) drawAlpha = static_cast<float>(toUpdate) / 1000000;
+            break;
+        case Timestep::loose:
+            if(toUpdate > 0 && addToUpdate < 0 && toUpdate + dToUpdate >= 1000000)
+            {
+                scene.update((toUpdate + addToUpdate) / updateRate, nextInputs());
+                addToUpdate = 1000000 - (toUpdate + addToUpdate);
+                toUpdate -= 1000000;
+                nbFramesToUpdate++;
+                nbTicks++;
+                scene.saveState();
+            }
+            break;
+        case Timestep::looseInterpolation:
+            // An early tick's state is already as of its time, drawn as is until the next whole tick.
+            // Blending from the state before it would go back in time.
+            if(addToUpdate > 0) break;
+            if(toUpdate + dToUpdate < 1000000)
+            {
+                // The next tick lasts addToUpdate longer, and toUpdate + addToUpdate of it passed
+                float elapsed = static_cast<float>(toUpdate + addToUpdate) / (1000000 + addToUpdate);
+                drawAlpha = std::min(std::max(elapsed, 0.f), 1.f);
+            }
+            else if(toUpdate > 0)
+            {
+                scene.update(toUpdate / updateRate, nextInputs());
+                addToUpdate = 1000000 - toUpdate;
+                toUpdate -= 1000000;
+                nbFramesToUpdate++;
+                nbTicks++;
+                scene.saveState();
+            }
+            break;
+    }
+    return nbFramesToUpdate;
+}
+
+void GameLoop::startUpdater()
+{
+    if(updaterRunning) return;
+    updaterRunning = true;
+    updater = std::thread(&GameLoop::updaterLoop, this);
+}
+
+void GameLoop::stopUpdater()
+{
+    if(!updaterRunning) return;
+    updaterRunning = false;
+    updater.join();
+    updatedScene = nullptr;
+    // The scene state is the one of the last tick, accumulate time from this frame on
+    prevUseconds = startTime;
+    toUpdate = 0;
+}
+
+void GameLoop::updaterLoop()
+{
+    // Telemetry only records from the main thread, ticks are not traced here
+    Scene *lastScene = nullptr;
+    int lastRate = 0;
+    int64_t start = 0, deadline = 0;
+    uint64_t nbDeadlines = 0;
+    while(updaterRunning.load(std::memory_order_relaxed))
+    {
+        {
+            std::lock_guard<std::mutex> lock(updateMutex);
+            int64_t now = clock.getTimeMicroseconds();
+            // Restart the schedule on changes, and rather than catching up after a long stall
+            uint8_t maxLateTicks = (updateRate / MAX_UPDATE_FRAMES_DIV) + 2;
+            if(updatedScene != lastScene || updateRate != lastRate
+                    || now - deadline > 1000000 * static_cast<int64_t>(maxLateTicks) / updateRate)
+            {
+                lastScene = updatedScene;
+                lastRate = updateRate;
+                start = now;
+                nbDeadlines = 0;
+            }
+            if(lastScene)
+            {
+                Inputs::State inputs = inputSource->getState();
+                lastScene->update(1000000 / updateRate, inputs);
+                nbTicks++;
+                clock.spinUntil(now + (simulatedUpdateTime + (randomUpdateTime ? rand() % randomUpdateTime : 0)) * 100);
+
+                int nbAhead = runAhead;
+                if(nbAhead)
+                {
+                    lastScene->saveState();
+                    runAheadTicks(*lastScene, inputs, nbAhead);
+                }
+                Snapshot &snapshot = snapshots.getWriteBuffer();
+                snapshot.scene = lastScene;
+                snapshot.tick = nbTicks;
+                snapshot.state.resize(lastScene->getStateSize());
+                lastScene->copyState(snapshot.state.data());
+                snapshots.publish();
+                if(nbAhead) lastScene->loadState();
+            }
+            deadline = start + static_cast<int64_t>(++nbDeadlines * 1000000 / updateRate);
+        }
+        updaterWait.waitUntil(deadline);
+    }
+}
+
+void GameLoop::endThreadedFrame(Scene &scene)
+{
+    startUpdater();
+    {
+        std::lock_guard<std::mutex> lock(updateMutex);
+        updatedScene = &scene;
+    }
+
+    // Draw the newest complete state, nothing until the scene published one
+    int64_t startDrawTime = clock.getTimeMicroseconds();
+    snapshots.update();
+    const Snapshot &snapshot = snapshots.getReadBuffer();
+    uint16_t drawTime = static_cast<uint16_t>(simulatedDrawTime + (randomDrawTime ? rand() % randomDrawTime : 0));
+    if(snapshot.scene == &scene)
+        display.draw(scene, snapshot.state.empty() ? nullptr : snapshot.state.data(), 1.f, drawTime);
+    else
+    {
+        Scene nothing;
+        display.draw(nothing, nullptr, 1.f, drawTime);
+    }
+    {
+        Telemetry::Scope scope(Telemetry::swap);
+        display.swap();
+    }
+    // There is no update left to delay, so predictive waiting only keeps the hard sync
+    bool resync = resyncRequested;
+    resyncRequested = false;
+    if(resync || inputLagMitigation >= InputLagMitigation::gpuSync) gpuHardSync();
+    if(resync) display.resync();
+    missedSync = false;
+    iterationTimes[currentFrame] = clock.getTimeMicroseconds() - startDrawTime;
+}
+
+void GameLoop::endFrame(Scene &scene)
+{
+    // Ticks are simulated again from their snapshots or from a file, they can't depend on the frame times
+    bool isReplaying = replay && replay->isActive();
+    if(isReplaying)
+    {
+        updateRate = replay->getUpdateRate();
+        timestep = replay->getTimestep();
+    }
+    if(rollback || isReplaying)
+    {
+        threading = Threading::singleThread;
+        if(timestep == Timestep::loose) timestep = Timestep::fixed;
+        if(timestep == Timestep::looseInterpolation) timestep = Timestep::interpolation;
+    }
+    if(threading == Threading::updateThread)
+    {
+        endThreadedFrame(scene);
+        return;
+    }
+    stopUpdater();
+
+    DisplayWindow::SyncMode syncMode = display.getSyncMode();
+    if(syncMode == DisplayWindow::SyncMode::noVSync && inputLagMitigation == InputLagMitigation::frameDelay)
+        inputLagMitigation = InputLagMitigation::gpuSync;
+
+    // Update
+    int64_t uSeconds = startTime;
+    int64_t dToUpdate = (uSeconds - prevUseconds) * updateRate;
+    toUpdate += dToUpdate;
+    prevUseconds = uSeconds;
+
+    uint8_t maxUpdateFrames = (updateRate / MAX_UPDATE_FRAMES_DIV) + 2;
+    if(toUpdate > 1000000 * maxUpdateFrames) toUpdate = 1000000 * maxUpdateFrames;
+    if(syncMode == DisplayWindow::noVSync && timestep == Timestep::fixed)
+    {
+        // Without V-Sync, the game update rate drives the frame rate
+        while(toUpdate <= 1000000)
+        {
+            clock.waitUntil(prevUseconds + (1000000 - toUpdate) / updateRate + 1);
+            uSeconds = clock.getTimeMicroseconds();
+            dToUpdate = (uSeconds - prevUseconds) * updateRate;
+            toUpdate += dToUpdate;
+            prevUseconds = uSeconds;
+            if(inputLagMitigation == InputLagMitigation::gpuSync) gpuHardSync();
+        }
+    }
+
+    // Costs depend on the scene, don't predict from another one
+    if(&scene != predictedScene)
+    {
+        frameDelayPredictor.reset();
+        predictedScene = &scene;
+    }
+    int64_t displayRefreshPeriod = display.getRefreshPeriod();
+    int64_t waitTime = frameDelayPredictor.getWaitTime(displayRefreshPeriod);
+    if(!missedSync && inputLagMitigation == InputLagMitigation::frameDelay && waitTime > 0)
+    {
+        Telemetry::Scope scope(Telemetry::frameDelay);
+        clock.waitUntil(uSeconds + waitTime);
+    }
+    else waitTime = 0;
+
+    int64_t updateStartTime = uSeconds = clock.getTimeMicroseconds();
+    uint8_t nbFramesToUpdate = updateScene(scene, dToUpdate);
+    clock.spinUntil(uSeconds + nbFramesToUpdate
+            * (simulatedUpdateTime + (randomUpdateTime ? rand() % randomUpdateTime : 0)) * 100);
+    int nbAhead = runAhead;
+    if(nbAhead)
+    {
+        // With the inputs the next tick will use, so the future drawn is the one that will happen
+        Telemetry::Scope scope(Telemetry::runAhead);
+        runAheadTicks(scene, heldInputs(), nbAhead);
+    }
+
+    // Draw
+    int64_t startDrawTime = clock.getTimeMicroseconds();
+    display.draw(scene, nullptr, drawAlpha, static_cast<uint16_t>(simulatedDrawTime + (randomDrawTime ? rand() % randomDrawTime : 0)));
+    int64_t drawTime = clock.getTimeMicroseconds() - startDrawTime;
+    if(replay) replay->addFrame(startTime, startDrawTime - updateStartTime, drawTime);
+    if(nbAhead) scene.loadState();
+    if(inputLagMitigation >= InputLagMitigation::frameDelay) gpuHardSync();
+    int64_t beforeSwapTime = clock.getTimeMicroseconds();
+    {
+        Telemetry::Scope scope(Telemetry::swap);
+        display.swap();
+    }
+    bool resync = resyncRequested;
+    resyncRequested = false;
+    if(resync || inputLagMitigation >= InputLagMitigation::gpuSync) gpuHardSync();
+    if(resync)
+    {
+        toUpdate = 0;
+        display.resync();
+    }
+    int64_t afterSwapTime = clock.getTimeMicroseconds();
+    if(inputLagMitigation >= InputLagMitigation::gpuSync) switch(display.getSyncMode())
+    {
+        case DisplayWindow::SyncMode::noVSync:
+            missedSync = false;
+            break;
+        case DisplayWindow::SyncMode::adaptiveSync:
+        case DisplayWindow::SyncMode::vSync:
+            missedSync = (afterSwapTime - startTime) >= displayRefreshPeriod * 1.1;
+            int64_t updateTime = startDrawTime - updateStartTime;
+            frameDelayPredictor.addFrame(updateTime, drawTime,
+                    beforeSwapTime - startTime - waitTime - updateTime - drawTime, missedSync);
+            break;
+    }
+    else missedSync = false;
+    iterationTimes[currentFrame] = afterSwapTime - updateStartTime;
+}
+
+int64_t SystemClock::getTimeMicroseconds()
+{
+    return TimeSource::getTimeMicroseconds();
+}
+
+void SystemClock::waitUntil(int64_t microseconds)
+{
+    preciseWait.waitUntil(microseconds);
+}
+
+void SystemClock::spinUntil(int64_t microseconds)
+{
+    while(getTimeMicroseconds() < microseconds);
+}
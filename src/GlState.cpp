@@ -0,0 +1,131 @@
+#include "GlState.hpp"
+
+// No object is ever bound with this name, the next call is always made
+static constexpr GLuint UNKNOWN = ~0u;
+
+GlState::GlState()
+{
+    invalidate();
+}
+
+void GlState::invalidate()
+{
+    program = vertexArray = framebuffer = texture = UNKNOWN;
+    activeTextureUnit = UNKNOWN;
+    for(int i = 0; i < 4; i++)
+    {
+        scissorBox[i] = viewportBox[i] = -1;
+        clearColorValue[i] = -1;
+    }
+    blend = -1;
+    blendSrc = blendDst = UNKNOWN;
+}
+
+bool GlState::needsCall(bool changed)
+{
+    if(changed) frameIssued++;
+    else frameElided++;
+    return changed;
+}
+
+void GlState::useProgram(GLuint program)
+{
+    if(!needsCall(program != this->program)) return;
+    this->program = program;
+    glUseProgram(program);
+}
+
+void GlState::bindVertexArray(GLuint vertexArray)
+{
+    if(!needsCall(vertexArray != this->vertexArray)) return;
+    this->vertexArray = vertexArray;
+    glBindVertexArray(vertexArray);
+}
+
+void GlState::bindFramebuffer(GLuint framebuffer)
+{
+    if(!needsCall(framebuffer != this->framebuffer)) return;
+    this->framebuffer = framebuffer;
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+}
+
+void GlState::activeTexture(GLenum unit)
+{
+    if(!needsCall(unit != activeTextureUnit)) return;
+    // Only the binding of one unit is kept
+    texture = UNKNOWN;
+    activeTextureUnit = unit;
+    glActiveTexture(unit);
+}
+
+void GlState::bindTexture(GLuint texture)
+{
+    if(!needsCall(texture != this->texture)) return;
+    this->texture = texture;
+    glBindTexture(GL_TEXTURE_2D, texture);
+}
+
+void GlState::scissor(GLint x, GLint y, GLsizei w, GLsizei h)
+{
+    if(!needsCall(x != scissorBox[0] || y != scissorBox[1] || w != scissorBox[2] || h != scissorBox[3])) return;
+    scissorBox[0] = x;
+    scissorBox[1] = y;
+    scissorBox[2] = w;
+    scissorBox[3] = h;
+    glScissor(x, y, w, h);
+}
+
+void GlState::viewport(GLint x, GLint y, GLsizei w, GLsizei h)
+{
+    if(!needsCall(x != viewportBox[0] || y != viewportBox[1] || w != viewportBox[2] || h != viewportBox[3])) return;
+    viewportBox[0] = x;
+    viewportBox[1] = y;
+    viewportBox[2] = w;
+    viewportBox[3] = h;
+    glViewport(x, y, w, h);
+}
+
+void GlState::clearColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a)
+{
+    if(!needsCall(r != clearColorValue[0] || g != clearColorValue[1] || b != clearColorValue[2]
+            || a != clearColorValue[3]))
+        return;
+    clearColorValue[0] = r;
+    clearColorValue[1] = g;
+    clearColorValue[2] = b;
+    clearColorValue[3] = a;
+    glClearColor(r, g, b, a);
+}
+
+void GlState::setBlend(bool enabled)
+{
+    if(!needsCall(blend != enabled)) return;
+    blend = enabled;
+    if(enabled) glEnable(GL_BLEND);
+    else glDisable(GL_BLEND);
+}
+
+void GlState::blendFunc(GLenum src, GLenum dst)
+{
+    if(!needsCall(src != blendSrc || dst != blendDst)) return;
+    blendSrc = src;
+    blendDst = dst;
+    glBlendFunc(src, dst);
+}
+
+void GlState::endFrame()
+{
+    nbIssued = frameIssued;
+    nbElided = frameElided;
+    frameIssued = frameElided = 0;
+}
+
+uint32_t GlState::getNbIssued() const
+{
+    return nbIssued;
+}
+
+uint32_t GlState::getNbElided() const
+{
+    return nbElided;
+}
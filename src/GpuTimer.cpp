@@ -0,0 +1,142 @@
+#include <algorithm>
+#include <iterator>
+#include "GpuTimer.hpp"
+#include "Telemetry.hpp"
+#include "TimeSource.hpp"
+
+constexpr uint8_t GpuTimer::NB_FRAMES;
+constexpr uint16_t GpuTimer::HISTORY_SIZE;
+constexpr uint32_t GpuTimer::RESYNC_PERIOD;
+
+const char GpuTimer::passNames[Pass::imGui + 1][16] =
+{
+    "Long draw",
+    "Scene draw",
+    "Window draw",
+    "ImGui"
+};
+
+void GpuTimer::init()
+{
+    supported = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+    if(!supported) return;
+    // The names of a previous context went with it
+    for(Frame &frame : frames)
+    {
+        glGenQueries((Pass::imGui + 1) * 2, &frame.queries[0][0]);
+        std::fill(std::begin(frame.issued), std::end(frame.issued), false);
+        frame.pending = false;
+    }
+    current = 0;
+    syncClocks();
+}
+
+void GpuTimer::syncClocks()
+{
+    // Drifts slowly, read again now and then
+    GLint64 gpuTime;
+    glGetInteger64v(GL_TIMESTAMP, &gpuTime);
+    clockOffset = TimeSource::getTimeNanoseconds() - gpuTime;
+}
+
+void GpuTimer::begin(Pass pass)
+{
+    if(supported) glQueryCounter(frames[current].queries[pass][0], GL_TIMESTAMP);
+}
+
+void GpuTimer::end(Pass pass)
+{
+    if(!supported) return;
+    glQueryCounter(frames[current].queries[pass][1], GL_TIMESTAMP);
+    frames[current].issued[pass] = true;
+}
+
+bool GpuTimer::isDone(const Frame &frame) const
+{
+    // The GPU runs them in order, the last one issued is the last done
+    int8_t last = Pass::imGui;
+    while(last >= 0 && !frame.issued[last]) last--;
+    if(last < 0) return true;
+    GLint available = GL_FALSE;
+    glGetQueryObjectiv(frame.queries[last][1], GL_QUERY_RESULT_AVAILABLE, &available);
+    return available == GL_TRUE;
+}
+
+void GpuTimer::collect(Frame &frame)
+{
+    for(uint8_t pass = Pass::longDraw; pass <= Pass::imGui; pass++)
+    {
+        if(!frame.issued[pass]) continue;
+        GLuint64 start, end;
+        glGetQueryObjectui64v(frame.queries[pass][0], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(frame.queries[pass][1], GL_QUERY_RESULT, &end);
+        history[pass][historyPos[pass]] = (end - start) / 1000.f;
+        historyPos[pass] = (historyPos[pass] + 1) % HISTORY_SIZE;
+        nbSamples[pass] = std::min<uint16_t>(nbSamples[pass] + 1, HISTORY_SIZE);
+        telemetry.record(static_cast<Telemetry::Phase>(Telemetry::gpuLongDraw + pass),
+                static_cast<int64_t>(start) + clockOffset, static_cast<int64_t>(end) + clockOffset,
+                frame.telemetryFrame);
+    }
+    frame.pending = false;
+}
+
+void GpuTimer::endFrame()
+{
+    if(!supported) return;
+    Frame &frame = frames[current];
+    frame.pending = std::find(std::begin(frame.issued), std::end(frame.issued), true) != std::end(frame.issued);
+    frame.telemetryFrame = telemetry.getFrame();
+    current = (current + 1) % NB_FRAMES;
+    if(++nbFrames % RESYNC_PERIOD == 0) syncClocks();
+
+    // Stops at the first one still running, the next ones can't be done either
+    for(uint8_t i = 0; i < NB_FRAMES; i++)
+    {
+        Frame &done = frames[(current + i) % NB_FRAMES];
+        if(!done.pending) continue;
+        if(!isDone(done)) break;
+        collect(done);
+    }
+    Frame &next = frames[current];
+    if(next.pending)
+    {
+        next.pending = false;
+        nbDropped++;
+    }
+    std::fill(std::begin(next.issued), std::end(next.issued), false);
+}
+
+bool GpuTimer::isSupported() const
+{
+    return supported;
+}
+
+const float* GpuTimer::getHistory(Pass pass) const
+{
+    return history[pass];
+}
+
+uint16_t GpuTimer::getHistoryOffset(Pass pass) const
+{
+    return nbSamples[pass] == HISTORY_SIZE ? historyPos[pass] : 0;
+}
+
+uint16_t GpuTimer::getNbSamples(Pass pass) const
+{
+    return nbSamples[pass];
+}
+
+float GpuTimer::getPercentile(Pass pass, float p) const
+{
+    if(!nbSamples[pass]) return 0;
+    float sorted[HISTORY_SIZE];
+    std::copy(history[pass], history[pass] + nbSamples[pass], sorted);
+    uint16_t index = static_cast<uint16_t>(std::min<float>(nbSamples[pass] * p, nbSamples[pass] - 1.f));
+    std::nth_element(sorted, sorted + index, sorted + nbSamples[pass]);
+    return sorted[index];
+}
+
+uint32_t GpuTimer::getNbDropped() const
+{
+    return nbDropped;
+}
@@ -0,0 +1,258 @@
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include "Headless.hpp"
+#include "Replay.hpp"
+
+int64_t SimulatedClock::getTimeMicroseconds()
+{
+    return time;
+}
+
+void SimulatedClock::waitUntil(int64_t microseconds)
+{
+    if(microseconds > time) time = microseconds;
+}
+
+void SimulatedClock::spinUntil(int64_t microseconds)
+{
+    if(microseconds > time) time = microseconds;
+}
+
+void SimulatedClock::advance(int64_t microseconds)
+{
+    time += microseconds;
+}
+
+SimulatedInputs::SimulatedInputs(SimulatedClock &clock) : clock(clock)
+{
+}
+
+Inputs::State SimulatedInputs::getState()
+{
+    lastSampleTime = clock.getTimeMicroseconds();
+    Inputs::State ret;
+    ret.x = 0;
+    ret.y = 0;
+    ret.pressed = (lastSampleTime / PRESS_PERIOD) % 2;
+    // Like the evdev thread, the time since the press arrived
+    ret.pressAge = ret.pressed ? static_cast<uint32_t>(lastSampleTime % PRESS_PERIOD) : 0;
+    ret.ack0 = false;
+    ret.ack1 = false;
+    ret.reset = false;
+    return ret;
+}
+
+SimulatedDisplay::SimulatedDisplay(SimulatedClock &clock, SimulatedInputs &inputs, int refreshRate)
+    : clock(clock), inputs(inputs), refreshPeriod(1000000 / refreshRate)
+{
+}
+
+int64_t SimulatedDisplay::nextVBlank(int64_t time) const
+{
+    return (time + refreshPeriod - 1) / refreshPeriod * refreshPeriod;
+}
+
+DisplayWindow::SyncMode SimulatedDisplay::getSyncMode() const
+{
+    return syncMode;
+}
+
+int64_t SimulatedDisplay::getRefreshPeriod()
+{
+    return refreshPeriod;
+}
+
+void SimulatedDisplay::draw(Scene &scene, const void *state, float alpha, uint16_t simulatedDrawTime)
+{
+    if(state) scene.drawState(state);
+    else scene.drawInterpolated(alpha);
+    frameInputTime = inputs.lastSampleTime;
+    clock.advance(cpuDrawTime);
+    gpuDoneTime = std::max(gpuDoneTime, clock.getTimeMicroseconds())
+            + gpuBaseTime + simulatedDrawTime * GPU_TIME_PER_DRAW_UNIT;
+}
+
+void SimulatedDisplay::swap()
+{
+    // Only one frame can be queued
+    clock.waitUntil(lastPresentTime);
+    int64_t presentTime = gpuDoneTime;
+    switch(syncMode)
+    {
+        case DisplayWindow::noVSync:
+            break;
+        case DisplayWindow::adaptiveSync:
+            if(presentTime <= lastPresentTime + refreshPeriod)
+                presentTime = nextVBlank(std::max(presentTime, lastPresentTime + 1));
+            break;
+        case DisplayWindow::vSync:
+            presentTime = nextVBlank(std::max(presentTime, lastPresentTime + 1));
+            break;
+    }
+    lastPresentTime = presentTime;
+    latencies.push_back(presentTime - frameInputTime);
+}
+
+void SimulatedDisplay::gpuHardSync()
+{
+    clock.waitUntil(std::max(gpuDoneTime, lastPresentTime));
+}
+
+SimulatedScene::SimulatedScene(SimulatedClock &clock) : clock(clock)
+{
+    strcpy(name, "Simulated");
+}
+
+void SimulatedScene::update(uint64_t microseconds, Inputs::State inputs)
+{
+    updateTimes.push_back(clock.getTimeMicroseconds());
+    times.beginTick();
+    times.cur += static_cast<int64_t>(microseconds);
+}
+
+void SimulatedScene::restartDrawCheck()
+{
+    lastDrawnTime = INT64_MIN;
+}
+
+void SimulatedScene::drawInterpolated(float alpha)
+{
+    int64_t drawnTime = TickStates<int64_t>::blend(times.prev, times.cur, alpha);
+    if(drawnTime < lastDrawnTime) nbBackwardDraws++;
+    lastDrawnTime = drawnTime;
+}
+
+InputHashScene::InputHashScene()
+{
+    strcpy(name, "Input hash");
+}
+
+void InputHashScene::update(uint64_t microseconds, Inputs::State inputs)
+{
+    // Field by field, the struct has padding and bit-fields
+    uint8_t buttons = static_cast<uint8_t>(inputs.pressed | inputs.ack0 << 1 | inputs.ack1 << 2 | inputs.reset << 3);
+    hash = hashBytes(&inputs.x, sizeof(inputs.x), hash);
+    hash = hashBytes(&inputs.y, sizeof(inputs.y), hash);
+    hash = hashBytes(&inputs.pressAge, sizeof(inputs.pressAge), hash);
+    hash = hashBytes(&buttons, sizeof(buttons), hash);
+}
+
+uint64_t InputHashScene::hashState() const
+{
+    return hash;
+}
+
+bool runHeadlessSweep(std::ostream &out, int64_t duration)
+{
+    static const int refreshRates[] = {60, 75, 144};
+    static const int updateRates[] = {30, 60, 120, 144};
+
+    out << "timestep,sync,mitigation,refreshRate,updateRate,frames,ticks,expectedTicks,missedSyncs,updateJitter,latency,"
+        << "maxLatency,backwardDraws" << std::endl;
+    uint32_t totalBackwardDraws = 0;
+    for(int8_t timestep = GameLoop::fixed; timestep <= GameLoop::looseInterpolation; timestep++)
+    for(int8_t syncMode = DisplayWindow::noVSync; syncMode <= DisplayWindow::vSync; syncMode++)
+    for(int8_t mitigation = GameLoop::none; mitigation <= GameLoop::frameDelay; mitigation++)
+    for(int refreshRate : refreshRates)
+    for(int updateRate : updateRates)
+    {
+        if(syncMode == DisplayWindow::noVSync && mitigation == GameLoop::frameDelay) continue;
+        srand(0);
+        SimulatedClock clock;
+        SimulatedInputs inputs(clock);
+        SimulatedDisplay display(clock, inputs, refreshRate);
+        SimulatedScene scene(clock);
+        display.syncMode = static_cast<DisplayWindow::SyncMode>(syncMode);
+        GameLoop loop(clock, display, inputs);
+        loop.updateRate = updateRate;
+        loop.timestep = static_cast<GameLoop::Timestep>(timestep);
+        loop.inputLagMitigation = static_cast<GameLoop::InputLagMitigation>(mitigation);
+        loop.requestResync();
+
+        uint32_t frames = 0, missedSyncs = 0;
+        while(clock.getTimeMicroseconds() < duration)
+        {
+            loop.beginFrame();
+            loop.endFrame(scene);
+            // The resync ending the first frame restarts the blend from the last tick
+            if(!frames) scene.restartDrawCheck();
+            frames++;
+            if(loop.hasMissedSync()) missedSyncs++;
+        }
+
+        // Standard deviation of the interval between two updates
+        double jitter = 0;
+        if(scene.updateTimes.size() > 2)
+        {
+            double sum = 0, sumSq = 0;
+            size_t n = scene.updateTimes.size() - 1;
+            for(size_t i = 0; i < n; i++)
+            {
+                double interval = static_cast<double>(scene.updateTimes[i + 1] - scene.updateTimes[i]);
+                sum += interval;
+                sumSq += interval * interval;
+            }
+            jitter = std::sqrt(std::max(0., sumSq / n - (sum / n) * (sum / n)));
+        }
+        int64_t totalLatency = 0, maxLatency = 0;
+        for(int64_t latency : display.latencies)
+        {
+            totalLatency += latency;
+            maxLatency = std::max(maxLatency, latency);
+        }
+        out << GameLoop::timestepNames[timestep] << "," << DisplayWindow::syncModeNames[syncMode] << ","
+            << GameLoop::inputLagMitigationNames[mitigation] << "," << refreshRate << "," << updateRate << "," << frames << ","
+            << loop.getNbTicks() << "," << duration * updateRate / 1000000 << "," << missedSyncs << ","
+            << static_cast<int64_t>(jitter) << ","
+            << (display.latencies.empty() ? 0 : totalLatency / static_cast<int64_t>(display.latencies.size())) << ","
+            << maxLatency << "," << scene.nbBackwardDraws << "\n";
+        totalBackwardDraws += scene.nbBackwardDraws;
+    }
+    out.flush();
+    return !totalBackwardDraws;
+}
+
+bool runReplayCheck(std::ostream &out, const char *path)
+{
+    static constexpr int64_t DURATION = 2000000;
+
+    // Apart, so the summary only has the playback's times
+    Replay replays[2];
+    uint64_t recordedHash = 0;
+    for(int pass = 0; pass < 2; pass++)
+    {
+        Replay &replay = replays[pass];
+        SimulatedClock clock;
+        SimulatedInputs inputs(clock);
+        SimulatedDisplay display(clock, inputs, 60);
+        InputHashScene scene;
+        GameLoop loop(clock, display, inputs);
+        loop.replay = &replay;
+        if(pass == 0 ? !replay.record(path, scene, loop) : !replay.play(path))
+        {
+            out << "Can't " << (pass == 0 ? "write " : "read ") << path << std::endl;
+            return false;
+        }
+        loop.requestResync();
+        // Playback ends by itself at the last tick, the time limit only guards against it never getting there
+        while(replay.isActive() && clock.getTimeMicroseconds() < DURATION * 2)
+        {
+            loop.beginFrame();
+            loop.endFrame(scene);
+            if(pass == 0 && clock.getTimeMicroseconds() >= DURATION) replay.stop();
+        }
+        if(pass == 0) recordedHash = scene.hashState();
+        else
+        {
+            replay.stop();
+            bool passed = replay.getTickPos() == replay.getNbTicks() && !replay.getNbMismatches()
+                    && scene.hashState() == recordedHash;
+            replay.writeSummary(out);
+            out << (passed ? "Replay check passed" : "Replay check failed") << std::endl;
+            return passed;
+        }
+    }
+    return false;
+}
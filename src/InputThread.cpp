@@ -0,0 +1,385 @@
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#ifdef __linux__
+#include <cerrno>
+#include <string>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <linux/input.h>
+#endif
+#include "InputThread.hpp"
+#include "TimeSource.hpp"
+
+const char InputThread::backendNames[Backend::evdev + 1][8] =
+{
+    "sdl",
+    "evdev"
+};
+
+namespace
+{
+    bool testBit(const uint8_t *bits, unsigned bit)
+    {
+        return bits[bit / 8] & (1 << (bit % 8));
+    }
+}
+
+InputThread::InputThread() : running(false), delayed(0)
+{
+}
+
+InputThread::~InputThread()
+{
+    stop();
+    closeEvdev();
+}
+
+bool InputThread::open(Backend backend, const std::vector<SDL_Joystick*> &joysticks, std::vector<JoystickState> &states)
+{
+    this->backend = backend;
+    this->joysticks.clear();
+    closeEvdev();
+    polled.clear();
+    if(backend == evdev)
+    {
+        if(!openEvdev()) return false;
+        states = polled;
+        // Keyboard keys are not joystick buttons
+        for(size_t i = 0; i < evdevDevices.size(); i++) if(evdevDevices[i].keyboard) states[i].buttons.clear();
+        return true;
+    }
+
+    this->joysticks = joysticks;
+    for(SDL_Joystick *js : joysticks)
+    {
+        JoystickState state;
+        state.buttons.resize(SDL_JoystickNumButtons(js));
+        for(size_t i = 0; i < state.buttons.size(); i++) state.buttons[i] = SDL_JoystickGetButton(js, i);
+        state.hats.resize(SDL_JoystickNumHats(js));
+        for(size_t i = 0; i < state.hats.size(); i++) state.hats[i] = SDL_JoystickGetHat(js, i);
+        state.axes.resize(SDL_JoystickNumAxes(js));
+        for(size_t i = 0; i < state.axes.size(); i++) state.axes[i] = SDL_JoystickGetAxis(js, i);
+        polled.push_back(state);
+    }
+    states = polled;
+    return true;
+}
+
+InputThread::Backend InputThread::getBackend() const
+{
+    return backend;
+}
+
+bool InputThread::hasKeyboard() const
+{
+    for(const EvdevDevice &device : evdevDevices) if(device.keyboard) return true;
+    return false;
+}
+
+bool InputThread::start(int rate)
+{
+    if(running) return false;
+    if(backend == evdev)
+    {
+        if(evdevDevices.empty()) return false;
+        running = true;
+        thread = std::thread(&InputThread::evdevLoop, this);
+        return true;
+    }
+    if(rate <= 0 || joysticks.empty()) return false;
+    period = 1000000000 / rate;
+    // The main thread pumping events must not update the joysticks anymore
+    SDL_JoystickEventState(SDL_IGNORE);
+    running = true;
+    thread = std::thread(&InputThread::loop, this);
+    return true;
+}
+
+void InputThread::stop()
+{
+    if(!running) return;
+    running = false;
+    thread.join();
+    if(backend == sdl) SDL_JoystickEventState(SDL_ENABLE);
+}
+
+bool InputThread::isRunning() const
+{
+    return running.load(std::memory_order_relaxed);
+}
+
+bool InputThread::push(uint8_t joystick, Kind kind, uint16_t index, int16_t value, int64_t time)
+{
+    Transition transition = {time, joystick, kind, index, value};
+    if(queue.push(transition)) return true;
+    delayed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void InputThread::poll()
+{
+    SDL_LockJoysticks();
+    SDL_JoystickUpdate();
+    int64_t now = TimeSource::getTimeNanoseconds();
+    for(size_t iJs = 0; iJs < joysticks.size(); iJs++)
+    {
+        SDL_Joystick *js = joysticks[iJs];
+        JoystickState &state = polled[iJs];
+        uint8_t id = static_cast<uint8_t>(iJs);
+        // The polled state only changes once the transition is queued, so a full queue delays it without losing it
+        for(uint16_t i = 0; i < state.buttons.size(); i++)
+        {
+            uint8_t value = SDL_JoystickGetButton(js, i);
+            if(value != state.buttons[i] && push(id, button, i, value, now)) state.buttons[i] = value;
+        }
+        for(uint16_t i = 0; i < state.hats.size(); i++)
+        {
+            uint8_t value = SDL_JoystickGetHat(js, i);
+            if(value != state.hats[i] && push(id, hat, i, value, now)) state.hats[i] = value;
+        }
+        for(uint16_t i = 0; i < state.axes.size(); i++)
+        {
+            int16_t value = SDL_JoystickGetAxis(js, i);
+            if(value != state.axes[i] && push(id, axis, i, value, now)) state.axes[i] = value;
+        }
+    }
+    SDL_UnlockJoysticks();
+}
+
+void InputThread::loop()
+{
+    // Absolute deadlines, so the polling rate doesn't drift with the time spent polling
+    std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+    while(running.load(std::memory_order_relaxed))
+    {
+        poll();
+        next += std::chrono::nanoseconds(period);
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if(next < now) next = now;
+        std::this_thread::sleep_until(next);
+    }
+}
+
+#ifdef __linux__
+bool InputThread::openEvdev()
+{
+    DIR *dir = opendir("/dev/input");
+    if(!dir)
+    {
+        std::cerr << "Can't list /dev/input" << std::endl;
+        return false;
+    }
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    int nbDenied = 0;
+    while(dirent *entry = readdir(dir))
+    {
+        if(strncmp(entry->d_name, "event", 5) || evdevDevices.size() > UINT8_MAX) continue;
+        std::string path = std::string("/dev/input/") + entry->d_name;
+        int fd = ::open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if(fd < 0)
+        {
+            if(errno == EACCES) nbDenied++;
+            continue;
+        }
+
+        uint8_t types[EV_CNT / 8 + 1] = {}, keys[KEY_CNT / 8 + 1] = {}, axes[ABS_CNT / 8 + 1] = {};
+        ioctl(fd, EVIOCGBIT(0, sizeof(types)), types);
+        ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keys)), keys);
+        ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(axes)), axes);
+        // Keyboards and joysticks only, not mice, touchpads nor power buttons
+        bool keyboard = testBit(keys, KEY_W) && testBit(keys, KEY_E) && testBit(keys, KEY_R);
+        bool joystick = testBit(keys, BTN_JOYSTICK) || testBit(keys, BTN_GAMEPAD);
+        if(testBit(types, EV_REL) || testBit(keys, BTN_TOUCH) || testBit(keys, BTN_LEFT) || (!keyboard && !joystick))
+        {
+            close(fd);
+            continue;
+        }
+        int clock = CLOCK_MONOTONIC;
+        ioctl(fd, EVIOCSCLOCKID, &clock);
+
+        EvdevDevice device = {fd, keyboard, false, false, {0, 0}, {0, 0}, 0, 0};
+        JoystickState state;
+        uint8_t pressed[NB_KEY_CODES / 8] = {};
+        ioctl(fd, EVIOCGKEY(sizeof(pressed)), pressed);
+        state.buttons.resize(NB_KEY_CODES);
+        for(uint16_t code = 0; code < NB_KEY_CODES; code++) state.buttons[code] = testBit(pressed, code);
+        if(!keyboard && testBit(axes, ABS_X) && testBit(axes, ABS_Y))
+        {
+            state.axes.resize(2);
+            for(int i = 0; i < 2; i++)
+            {
+                input_absinfo info;
+                ioctl(fd, EVIOCGABS(ABS_X + i), &info);
+                device.axisMin[i] = info.minimum;
+                device.axisMax[i] = info.maximum > info.minimum ? info.maximum : info.minimum + 1;
+            }
+        }
+        if(!keyboard && testBit(axes, ABS_HAT0X) && testBit(axes, ABS_HAT0Y)) state.hats.resize(1, SDL_HAT_CENTERED);
+
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u32 = static_cast<uint32_t>(evdevDevices.size());
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+        evdevDevices.push_back(device);
+        polled.push_back(state);
+        // Axes and hats are queued as transitions from the center
+        resyncEvdev(static_cast<uint8_t>(evdevDevices.size() - 1), TimeSource::getTimeNanoseconds());
+    }
+    closedir(dir);
+    if(evdevDevices.empty())
+    {
+        std::cerr << "No keyboard nor joystick in /dev/input";
+        if(nbDenied) std::cerr << ", " << nbDenied << " devices not readable, is the user in the input group?";
+        std::cerr << std::endl;
+        closeEvdev();
+        return false;
+    }
+    return true;
+}
+
+void InputThread::closeEvdev()
+{
+    for(EvdevDevice &device : evdevDevices) if(device.fd >= 0) close(device.fd);
+    evdevDevices.clear();
+    if(epollFd >= 0) close(epollFd);
+    epollFd = -1;
+}
+
+void InputThread::applyEvdev(uint8_t iDevice, uint16_t type, uint16_t code, int32_t value, int64_t time)
+{
+    EvdevDevice &device = evdevDevices[iDevice];
+    JoystickState &state = polled[iDevice];
+    if(type == EV_KEY && code < NB_KEY_CODES && value != 2) // 2 is auto-repeat
+    {
+        if(value == state.buttons[code]) return;
+        if(push(iDevice, device.keyboard ? key : button, code, value != 0, time)) state.buttons[code] = value != 0;
+        else device.delayed = true;
+    }
+    else if(type == EV_ABS && (code == ABS_X || code == ABS_Y) && !state.axes.empty())
+    {
+        int i = code - ABS_X;
+        int64_t scaled = (static_cast<int64_t>(value) - device.axisMin[i]) * 65534
+                / (device.axisMax[i] - device.axisMin[i]) - 32767;
+        int16_t clamped = static_cast<int16_t>(scaled < -32767 ? -32767 : scaled > 32767 ? 32767 : scaled);
+        if(clamped == state.axes[i]) return;
+        if(push(iDevice, axis, static_cast<uint16_t>(i), clamped, time)) state.axes[i] = clamped;
+        else device.delayed = true;
+    }
+    else if(type == EV_ABS && (code == ABS_HAT0X || code == ABS_HAT0Y) && !state.hats.empty())
+    {
+        int8_t direction = static_cast<int8_t>(value < 0 ? -1 : value > 0 ? 1 : 0);
+        if(code == ABS_HAT0X) device.hatX = direction;
+        else device.hatY = direction;
+        uint8_t hatValue = (device.hatY < 0 ? SDL_HAT_UP : 0) | (device.hatX > 0 ? SDL_HAT_RIGHT : 0)
+                | (device.hatY > 0 ? SDL_HAT_DOWN : 0) | (device.hatX < 0 ? SDL_HAT_LEFT : 0);
+        if(hatValue == state.hats[0]) return;
+        if(push(iDevice, hat, 0, hatValue, time)) state.hats[0] = hatValue;
+        else device.delayed = true;
+    }
+}
+
+void InputThread::resyncEvdev(uint8_t iDevice, int64_t time)
+{
+    EvdevDevice &device = evdevDevices[iDevice];
+    JoystickState &state = polled[iDevice];
+    device.dropped = false;
+    device.delayed = false;
+    uint8_t pressed[NB_KEY_CODES / 8] = {};
+    ioctl(device.fd, EVIOCGKEY(sizeof(pressed)), pressed);
+    for(uint16_t code = 0; code < NB_KEY_CODES; code++)
+        if(testBit(pressed, code) != (state.buttons[code] != 0)) applyEvdev(iDevice, EV_KEY, code, testBit(pressed, code), time);
+    static const uint16_t codes[] = {ABS_X, ABS_Y, ABS_HAT0X, ABS_HAT0Y};
+    for(uint16_t code : codes)
+    {
+        input_absinfo info;
+        if(ioctl(device.fd, EVIOCGABS(code), &info) == 0) applyEvdev(iDevice, EV_ABS, code, info.value, time);
+    }
+}
+
+void InputThread::evdevLoop()
+{
+    epoll_event ready[EVDEV_BATCH];
+    input_event events[EVDEV_BATCH];
+    bool anyDelayed = false;
+    while(running.load(std::memory_order_relaxed))
+    {
+        // Retry soon when transitions are waiting for room in the queue
+        int nbReady = epoll_wait(epollFd, ready, EVDEV_BATCH, anyDelayed ? 1 : EVDEV_TIMEOUT);
+        for(int iReady = 0; iReady < nbReady; iReady++)
+        {
+            uint8_t iDevice = static_cast<uint8_t>(ready[iReady].data.u32);
+            EvdevDevice &device = evdevDevices[iDevice];
+            ssize_t size;
+            while((size = read(device.fd, events, sizeof(events))) > 0)
+            {
+                for(size_t i = 0; i < static_cast<size_t>(size) / sizeof(input_event); i++)
+                {
+                    const input_event &event = events[i];
+                    int64_t time = TimeSource::fromMonotonicNanoseconds(
+                            static_cast<int64_t>(event.input_event_sec) * 1000000000
+                            + static_cast<int64_t>(event.input_event_usec) * 1000);
+                    if(event.type == EV_SYN && event.code == SYN_DROPPED) device.dropped = true;
+                    else if(device.dropped)
+                    {
+                        // The kernel state is only consistent again at the next report
+                        if(event.type == EV_SYN && event.code == SYN_REPORT) resyncEvdev(iDevice, time);
+                    }
+                    else applyEvdev(iDevice, event.type, event.code, event.value, time);
+                }
+            }
+            if(size < 0 && errno == ENODEV)
+            {
+                // Unplugged
+                epoll_ctl(epollFd, EPOLL_CTL_DEL, device.fd, nullptr);
+                close(device.fd);
+                device.fd = -1;
+            }
+        }
+
+        anyDelayed = false;
+        for(size_t iDevice = 0; iDevice < evdevDevices.size(); iDevice++)
+        {
+            if(evdevDevices[iDevice].delayed && evdevDevices[iDevice].fd >= 0)
+                resyncEvdev(static_cast<uint8_t>(iDevice), TimeSource::getTimeNanoseconds());
+            anyDelayed |= evdevDevices[iDevice].delayed;
+        }
+    }
+}
+#else
+bool InputThread::openEvdev()
+{
+    std::cerr << "evdev is only available on Linux" << std::endl;
+    return false;
+}
+
+void InputThread::closeEvdev()
+{
+}
+
+void InputThread::evdevLoop()
+{
+}
+
+void InputThread::applyEvdev(uint8_t iDevice, uint16_t type, uint16_t code, int32_t value, int64_t time)
+{
+}
+
+void InputThread::resyncEvdev(uint8_t iDevice, int64_t time)
+{
+}
+#endif
+
+bool InputThread::pop(Transition &transition)
+{
+    return queue.pop(transition);
+}
+
+uint32_t InputThread::getNbDelayed() const
+{
+    return delayed.load(std::memory_order_relaxed);
+}
@@ -1,48 +1,287 @@
 #include "Inputs.hpp"
+#include "TimeSource.hpp"
 #include <tuple>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <iostream>
+#ifdef __linux__
+#include <linux/input.h>
+#endif
 
-void Inputs::init()
+const char Inputs::scriptInputNames[ScriptInput::reset + 1][8] =
 {
+    "pressed",
+    "ack0",
+    "ack1",
+    "reset"
+};
+
+namespace
+{
+    // Keys with a meaning of their own keep their SDL scancode
+    int keyFromEvdev(uint16_t code)
+    {
+#ifdef __linux__
+        switch(code)
+        {
+            case KEY_W: return SDL_SCANCODE_W;
+            case KEY_E: return SDL_SCANCODE_E;
+            case KEY_R: return SDL_SCANCODE_R;
+            case KEY_LEFT: return SDL_SCANCODE_LEFT;
+            case KEY_RIGHT: return SDL_SCANCODE_RIGHT;
+            case KEY_UP: return SDL_SCANCODE_UP;
+            case KEY_DOWN: return SDL_SCANCODE_DOWN;
+        }
+#endif
+        return SDL_NUM_SCANCODES + code;
+    }
+}
+
+void Inputs::init(InputThread::Backend backend, int rate)
+{
+    mainThread = std::this_thread::get_id();
     int nbJoysticks = SDL_NumJoysticks();
     for(int iJs = 0; iJs < nbJoysticks; iJs++)
     {
         SDL_Joystick *js = SDL_JoystickOpen(iJs);
-        if(js) joysticks.push_back(js);
+        if(!js) continue;
+        joysticks.push_back(js);
+        joystickIds.push_back(SDL_JoystickInstanceID(js));
+    }
+    if(!inputThread.open(backend, joysticks, joystickStates))
+    {
+        std::cerr << "Input backend " << InputThread::backendNames[backend] << " not available, using "
+                << InputThread::backendNames[InputThread::sdl] << std::endl;
+        inputThread.open(InputThread::sdl, joysticks, joystickStates);
+    }
+    for(const InputThread::JoystickState &js : joystickStates)
+    {
+        for(uint8_t hat : js.hats) if(hat != SDL_HAT_CENTERED) nbTimedPresses++;
+        for(uint8_t button : js.buttons) if(button) nbTimedPresses++;
     }
+    inputThread.start(rate);
+
+    live.pressed = live.ack0 = live.ack1 = live.reset = false;
+    if(!inputThread.hasKeyboard())
+    {
+        int nbKeys;
+        const Uint8* keyboard = SDL_GetKeyboardState(&nbKeys);
+        for(int i = 0; i < nbKeys && i < SDL_NUM_SCANCODES; i++) if(keyboard[i]) applyKey(i, true, 0);
+    }
+    live.x = 0;
+    live.y = 0;
+    live.pressAge = 0;
+    xyChanged = true;
 }
 
-Inputs::State Inputs::getState()
+InputThread::Backend Inputs::getBackend() const
 {
-    SDL_PumpEvents();
-    State ret;
-    ret.pressed = isAnyInputPressed();
-    int nbKeys;
-    const Uint8* keys = SDL_GetKeyboardState(&nbKeys);
-    ret.ack0 = nbKeys > SDL_SCANCODE_W && keys[SDL_SCANCODE_W];
-    ret.ack1 = nbKeys > SDL_SCANCODE_E && keys[SDL_SCANCODE_E];
-    ret.test = nbKeys > SDL_SCANCODE_T && keys[SDL_SCANCODE_T];
-    ret.reset = nbKeys > SDL_SCANCODE_R && keys[SDL_SCANCODE_R];
-    std::tie(ret.x, ret.y) = getXY();
-    return ret;
+    return inputThread.getBackend();
 }
 
-bool Inputs::isAnyInputPressed() const
+uint32_t Inputs::getNbDelayedTransitions() const
 {
-    // Joystick
-    for(SDL_Joystick *js : joysticks)
+    return inputThread.getNbDelayed();
+}
+
+const Inputs::KeyDelay& Inputs::getSdlKeyDelay() const
+{
+    return sdlKeyDelay;
+}
+
+void Inputs::applyKey(int key, bool down, int64_t time)
+{
+    if(keys[key] == down) return;
+    keys[key] = down;
+    switch(key)
     {
-        int n = SDL_JoystickNumHats(js);
-        for(int iHat = 0; iHat < n; iHat++) if(SDL_JoystickGetHat(js, iHat) != SDL_HAT_CENTERED) return true;
-        n = SDL_JoystickNumButtons(js);
-        for(int iBtn = 0; iBtn < n; iBtn++) if(SDL_JoystickGetButton(js, iBtn)) return true;
+        case SDL_SCANCODE_W:
+            live.ack0 = down;
+            break;
+        case SDL_SCANCODE_E:
+            live.ack1 = down;
+            break;
+        case SDL_SCANCODE_R:
+            live.reset = down;
+            break;
+        case SDL_SCANCODE_LEFT:
+        case SDL_SCANCODE_RIGHT:
+        case SDL_SCANCODE_UP:
+        case SDL_SCANCODE_DOWN:
+            xyChanged = true;
+            // Fall through, arrows are presses too
+        default:
+            if(!time) nbKeyPresses += down ? 1 : -1;
+            else if(!down) nbTimedPresses--;
+            else if(!nbTimedPresses++) lastPressTime = time;
     }
+}
 
-    // Keyboard
-    int nbKeys;
-    const Uint8* keys = SDL_GetKeyboardState(&nbKeys);
-    for(int i = 0; i < nbKeys; i++) if(keys[i] && i != SDL_SCANCODE_T && i != SDL_SCANCODE_R && i != SDL_SCANCODE_W && i != SDL_SCANCODE_E) return true;
+void Inputs::applyTransition(const InputThread::Transition &transition)
+{
+    if(transition.kind == InputThread::key)
+    {
+        if(transition.value && !keys[keyFromEvdev(transition.index)]) lastEvdevKeyTime = transition.time;
+        applyKey(keyFromEvdev(transition.index), transition.value != 0, transition.time);
+        return;
+    }
+    InputThread::JoystickState &state = joystickStates[transition.joystick];
+    switch(transition.kind)
+    {
+        case InputThread::button:
+            if(transition.value && !state.buttons[transition.index])
+            {
+                if(!nbTimedPresses++) lastPressTime = transition.time;
+            }
+            else if(!transition.value && state.buttons[transition.index]) nbTimedPresses--;
+            state.buttons[transition.index] = static_cast<uint8_t>(transition.value);
+            break;
+        case InputThread::hat:
+            if(transition.value != SDL_HAT_CENTERED && state.hats[transition.index] == SDL_HAT_CENTERED)
+            {
+                if(!nbTimedPresses++) lastPressTime = transition.time;
+            }
+            else if(transition.value == SDL_HAT_CENTERED && state.hats[transition.index] != SDL_HAT_CENTERED)
+                nbTimedPresses--;
+            state.hats[transition.index] = static_cast<uint8_t>(transition.value);
+            if(transition.index == 0) xyChanged = true;
+            break;
+        case InputThread::axis:
+            state.axes[transition.index] = transition.value;
+            if(transition.index < 2) xyChanged = true;
+            break;
+        case InputThread::key:
+            break;
+    }
+}
 
-    return false;
+bool Inputs::toTransition(const SDL_Event &event, InputThread::Transition &transition) const
+{
+    SDL_JoystickID id;
+    switch(event.type)
+    {
+        case SDL_JOYBUTTONDOWN:
+        case SDL_JOYBUTTONUP:
+            id = event.jbutton.which;
+            transition.kind = InputThread::button;
+            transition.index = event.jbutton.button;
+            transition.value = event.jbutton.state == SDL_PRESSED;
+            break;
+        case SDL_JOYHATMOTION:
+            id = event.jhat.which;
+            transition.kind = InputThread::hat;
+            transition.index = event.jhat.hat;
+            transition.value = event.jhat.value;
+            break;
+        case SDL_JOYAXISMOTION:
+            id = event.jaxis.which;
+            transition.kind = InputThread::axis;
+            transition.index = event.jaxis.axis;
+            transition.value = event.jaxis.value;
+            break;
+        default:
+            return false;
+    }
+    size_t iJs = std::find(joystickIds.begin(), joystickIds.end(), id) - joystickIds.begin();
+    if(iJs == joystickIds.size()) return false;
+    const InputThread::JoystickState &state = joystickStates[iJs];
+    size_t size = transition.kind == InputThread::button ? state.buttons.size()
+            : transition.kind == InputThread::hat ? state.hats.size() : state.axes.size();
+    if(transition.index >= size) return false;
+    transition.joystick = static_cast<uint8_t>(iJs);
+    // SDL event timestamps are in ms, too coarse
+    transition.time = TimeSource::getTimeNanoseconds();
+    return true;
+}
+
+void Inputs::processEvents(bool pump)
+{
+    if(pump) SDL_PumpEvents();
+
+    // Transitions first, so the evdev keys come before the SDL ones
+    int nbEvents;
+    if(inputThread.isRunning())
+    {
+        InputThread::Transition transition;
+        while(inputThread.pop(transition)) applyTransition(transition);
+    }
+    else do
+    {
+        SDL_Event events[EVENT_BATCH];
+        nbEvents = SDL_PeepEvents(events, EVENT_BATCH, SDL_GETEVENT, SDL_JOYAXISMOTION, SDL_JOYBUTTONUP);
+        InputThread::Transition transition;
+        for(int i = 0; i < nbEvents; i++) if(toTransition(events[i], transition)) applyTransition(transition);
+    } while(nbEvents == EVENT_BATCH);
+
+    // All the other events are kept for pollEvent, in their order, the keys applied on the way
+    bool evdevKeyboard = inputThread.hasKeyboard();
+    int64_t now = TimeSource::getTimeNanoseconds();
+    do
+    {
+        size_t first = events.size();
+        events.resize(first + EVENT_BATCH);
+        nbEvents = SDL_PeepEvents(&events[first], EVENT_BATCH, SDL_GETEVENT, SDL_FIRSTEVENT, SDL_LASTEVENT);
+        events.resize(first + std::max(nbEvents, 0));
+        for(size_t i = first; i < events.size(); i++)
+        {
+            if(events[i].type != SDL_KEYDOWN && events[i].type != SDL_KEYUP) continue;
+            const SDL_KeyboardEvent &key = events[i].key;
+            if(!evdevKeyboard)
+            {
+                if(key.keysym.scancode < SDL_NUM_SCANCODES) applyKey(key.keysym.scancode, key.type == SDL_KEYDOWN, 0);
+            }
+            else if(key.type == SDL_KEYDOWN && !key.repeat && lastEvdevKeyTime)
+            {
+                // Measure how much later SDL delivers the same press
+                int64_t delay = now - lastEvdevKeyTime;
+                lastEvdevKeyTime = 0;
+                if(delay < 0 || delay >= 1000000000) continue;
+                sdlKeyDelay.count++;
+                sdlKeyDelay.total += delay;
+                if(delay > sdlKeyDelay.max) sdlKeyDelay.max = delay;
+            }
+        }
+    } while(nbEvents == EVENT_BATCH);
+
+    if(xyChanged)
+    {
+        std::tie(live.x, live.y) = getXY();
+        xyChanged = false;
+    }
+}
+
+bool Inputs::pollEvent(SDL_Event &event)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if(eventPos == events.size())
+    {
+        events.clear();
+        eventPos = 0;
+        processEvents(true);
+    }
+    if(eventPos == events.size()) return false;
+    event = events[eventPos++];
+    return true;
+}
+
+Inputs::State Inputs::getState()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if(!script.empty()) return getScriptState();
+    processEvents(std::this_thread::get_id() == mainThread);
+    live.pressed = nbKeyPresses + nbTimedPresses > 0;
+    live.pressAge = 0;
+    if(nbTimedPresses)
+    {
+        // Keyboard presses have no arrival time, only joystick ones
+        int64_t age = (TimeSource::getTimeNanoseconds() - lastPressTime) / 1000;
+        if(age >= 0 && age < 1000000) live.pressAge = static_cast<uint32_t>(age);
+    }
+    return live;
 }
 
 std::pair<int16_t, int16_t> Inputs::getXY() const
@@ -50,11 +289,11 @@ std::pair<int16_t, int16_t> Inputs::getXY() const
     int x = 0, y = 0;
 
     // Joystick
-    for(SDL_Joystick *js : joysticks)
+    for(const InputThread::JoystickState &js : joystickStates)
     {
-        if(SDL_JoystickNumHats(js))
+        if(!js.hats.empty())
         {
-            switch(SDL_JoystickGetHat(js, 0))
+            switch(js.hats[0])
             {
                 case SDL_HAT_LEFTUP:
                 	x -= 32767;
@@ -95,17 +334,16 @@ std::pair<int16_t, int16_t> Inputs::getXY() const
                     y -= 32767;
             }
         }
-        if(SDL_JoystickNumAxes(js) >= 2)
+        if(js.axes.size() >= 2)
         {
-            x += SDL_JoystickGetAxis(js, 0);
-            y += SDL_JoystickGetAxis(js, 1);
+            x += js.axes[0];
+            y += js.axes[1];
         }
     }
     if(x < -32767) x = -32767; else if(x > 32767) x = 32767;
     if(y < -32767) y = -32767; else if(y > 32767) y = 32767;
 
     // Keyboard
-    const Uint8* keys = SDL_GetKeyboardState(nullptr);
     if(keys[SDL_SCANCODE_LEFT])  x -= 32767;
     if(keys[SDL_SCANCODE_RIGHT]) x += 32767;
     if(keys[SDL_SCANCODE_UP])    y -= 32767;
@@ -115,3 +353,118 @@ std::pair<int16_t, int16_t> Inputs::getXY() const
 
     return std::make_pair(x, y);
 }
+
+void Inputs::applyScriptEvent(const ScriptEvent &event)
+{
+    switch(event.input)
+    {
+        case pressed:
+            scriptState.pressed = event.value;
+            break;
+        case ack0:
+            scriptState.ack0 = event.value;
+            break;
+        case ack1:
+            scriptState.ack1 = event.value;
+            break;
+        case reset:
+            scriptState.reset = event.value;
+            break;
+    }
+}
+
+Inputs::State Inputs::getScriptState()
+{
+    int64_t now = TimeSource::getTimeMicroseconds();
+    if(scriptStart < 0)
+    {
+        scriptStart = now;
+        scriptState.x = 0;
+        scriptState.y = 0;
+        scriptState.pressAge = 0;
+        scriptState.pressed = scriptState.ack0 = scriptState.ack1 = scriptState.reset = false;
+    }
+    int64_t time = now - scriptStart;
+    if(scriptRepeat && time >= scriptRepeat)
+    {
+        // Finish the previous repetition before starting the next one
+        for(; scriptPos < script.size(); scriptPos++) applyScriptEvent(script[scriptPos]);
+        scriptStart += time / scriptRepeat * scriptRepeat;
+        time %= scriptRepeat;
+        scriptPos = 0;
+    }
+    for(; scriptPos < script.size() && script[scriptPos].time <= time; scriptPos++)
+        applyScriptEvent(script[scriptPos]);
+    return scriptState;
+}
+
+bool Inputs::loadScript(const char *path)
+{
+    std::ifstream file(path);
+    if(!file) return false;
+    std::vector<ScriptEvent> loaded;
+    int64_t repeat = 0;
+    std::string line;
+    while(std::getline(file, line))
+    {
+        std::istringstream stream(line);
+        std::string first, name;
+        int value;
+        if(!(stream >> first) || first[0] == '#') continue;
+        if(first == "repeat")
+        {
+            if(!(stream >> repeat)) return false;
+            repeat *= 1000;
+            continue;
+        }
+        if(!(stream >> name >> value)) return false;
+        uint8_t input = 0;
+        while(input <= reset && name != scriptInputNames[input]) input++;
+        if(input > reset) return false;
+        ScriptEvent event = {static_cast<int64_t>(atof(first.c_str()) * 1000), static_cast<ScriptInput>(input),
+                value != 0};
+        if(!loaded.empty() && event.time < loaded.back().time) return false;
+        loaded.push_back(event);
+    }
+    if(loaded.empty()) return false;
+    script = loaded;
+    scriptRepeat = repeat;
+    scriptPos = 0;
+    scriptStart = -1;
+    return true;
+}
+
+void Inputs::generateScript(uint16_t nbPresses, int64_t period, int64_t reaction0, int64_t reaction1)
+{
+    script.clear();
+    int64_t hold = std::max(reaction0, reaction1) + period / 4;
+    for(uint16_t i = 0; i < nbPresses; i++)
+    {
+        // Leave the scene one period to settle before the first press
+        int64_t start = (i + 1) * period;
+        ScriptEvent events[6] =
+        {
+            {start, pressed, true},
+            {start + reaction0, ack0, true},
+            {start + reaction1, ack1, true},
+            {start + hold, pressed, false},
+            {start + hold, ack0, false},
+            {start + hold, ack1, false}
+        };
+        if(reaction1 < reaction0) std::swap(events[1], events[2]);
+        script.insert(script.end(), events, events + 6);
+    }
+    scriptRepeat = 0;
+    scriptPos = 0;
+    scriptStart = -1;
+}
+
+bool Inputs::isScripted() const
+{
+    return !script.empty();
+}
+
+bool Inputs::isScriptFinished() const
+{
+    return !script.empty() && !scriptRepeat && scriptPos == script.size();
+}
@@ -0,0 +1,272 @@
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include "LatencySweep.hpp"
+#include "TimeSource.hpp"
+
+namespace
+{
+    bool equalsIgnoreCase(const std::string &a, const char *b)
+    {
+        size_t i = 0;
+        for(; i < a.size() && b[i]; i++) if(tolower(a[i]) != tolower(b[i])) return false;
+        return i == a.size() && !b[i];
+    }
+
+    // Index or case-insensitive name
+    template<typename T, size_t N, size_t L>
+    bool parseEnumList(const std::string &value, const char (&names)[N][L], std::vector<T> &out)
+    {
+        std::vector<T> parsed;
+        std::istringstream stream(value);
+        std::string item;
+        while(std::getline(stream, item, ','))
+        {
+            size_t i = 0;
+            while(i < N && !equalsIgnoreCase(item, names[i])) i++;
+            if(i == N)
+            {
+                char *end;
+                i = strtoul(item.c_str(), &end, 10);
+                if(*end || i >= N) return false;
+            }
+            parsed.push_back(static_cast<T>(i));
+        }
+        out = parsed;
+        return !out.empty();
+    }
+
+    bool parseIntList(const std::string &value, std::vector<int> &out)
+    {
+        std::vector<int> parsed;
+        std::istringstream stream(value);
+        std::string item;
+        while(std::getline(stream, item, ','))
+        {
+            char *end;
+            parsed.push_back(static_cast<int>(strtol(item.c_str(), &end, 10)));
+            if(*end) return false;
+        }
+        out = parsed;
+        return !out.empty();
+    }
+}
+
+bool LatencySweep::parseSetting(const std::string &key, const std::string &value)
+{
+    if(key == "rates") return parseIntList(value, config.updateRates);
+    if(key == "draw-times") return parseIntList(value, config.drawTimes);
+    if(key == "sync") return parseEnumList(value, DisplayWindow::syncModeNames, config.syncModes);
+    if(key == "mitigations") return parseEnumList(value, GameLoop::inputLagMitigationNames, config.mitigations);
+    if(key == "timesteps") return parseEnumList(value, GameLoop::timestepNames, config.timesteps);
+    if(key == "repeat")
+    {
+        config.repetitions = static_cast<uint16_t>(std::max(atoi(value.c_str()), 1));
+        return true;
+    }
+    if(key == "duration")
+    {
+        config.duration = atoll(value.c_str()) * 1000;
+        return config.duration > 0;
+    }
+    if(key == "warmup")
+    {
+        config.warmup = atoll(value.c_str()) * 1000;
+        return config.warmup >= 0;
+    }
+    if(key == "output")
+    {
+        config.output = value;
+        return !value.empty();
+    }
+    return false;
+}
+
+bool LatencySweep::parseArgument(const char *arg)
+{
+    if(!strcmp(arg, "--sweep"))
+    {
+        enabled = true;
+        return true;
+    }
+    if(!strncmp(arg, "--sweep=", 8))
+    {
+        enabled = true;
+        std::ifstream file(arg + 8);
+        if(!file)
+        {
+            std::cerr << "Can't open sweep scenario " << arg + 8 << ", latency sweep disabled" << std::endl;
+            invalid = true;
+            return true;
+        }
+        std::string line;
+        while(std::getline(file, line))
+        {
+            if(line.empty() || line[0] == '#') continue;
+            size_t equal = line.find('=');
+            if(equal == std::string::npos || !parseSetting(line.substr(0, equal), line.substr(equal + 1)))
+            {
+                std::cerr << "Invalid sweep setting " << line << ", latency sweep disabled" << std::endl;
+                invalid = true;
+            }
+        }
+        return true;
+    }
+    if(!strncmp(arg, "--sweep-", 8))
+    {
+        enabled = true;
+        const char *equal = strchr(arg, '=');
+        if(!equal || !parseSetting(std::string(arg + 8, equal), equal + 1))
+        {
+            std::cerr << "Invalid sweep setting " << arg << ", latency sweep disabled" << std::endl;
+            invalid = true;
+        }
+        return true;
+    }
+    return false;
+}
+
+bool LatencySweep::isEnabled() const
+{
+    return enabled && !invalid;
+}
+
+const LatencySweep::Run& LatencySweep::getRun() const
+{
+    return runs[currentRun];
+}
+
+bool LatencySweep::start(GameLoop &loop)
+{
+    this->loop = &loop;
+    runs.clear();
+    for(int drawTime : config.drawTimes)
+    for(int updateRate : config.updateRates)
+    for(GameLoop::Timestep timestep : config.timesteps)
+    for(DisplayWindow::SyncMode syncMode : config.syncModes)
+    for(GameLoop::InputLagMitigation mitigation : config.mitigations)
+    for(uint16_t repetition = 0; repetition < config.repetitions; repetition++)
+    {
+        if(syncMode == DisplayWindow::noVSync && mitigation == GameLoop::frameDelay) continue;
+        Run run = {updateRate, drawTime, syncMode, mitigation, timestep, repetition};
+        runs.push_back(run);
+    }
+    currentRun = 0;
+    if(runs.empty())
+    {
+        std::cerr << "Empty latency sweep" << std::endl;
+        enabled = false;
+        return false;
+    }
+    output.open(config.output, std::ofstream::out | std::ofstream::trunc);
+    output << "updateRate,drawTime,sync,mitigation,timestep,repetition,sample,latency,ticks\n";
+    loop.setInputSource(*this);
+    startRun(TimeSource::getTimeMicroseconds());
+    return true;
+}
+
+void LatencySweep::startRun(int64_t now)
+{
+    const Run &run = runs[currentRun];
+    loop->updateRate = run.updateRate;
+    loop->simulatedDrawTime = run.drawTime;
+    loop->randomDrawTime = run.drawTime / 5;
+    loop->timestep = run.timestep;
+    loop->inputLagMitigation = run.mitigation;
+    // The press state is shared with getState without a lock, and a frame is only known to have consumed the press
+    // when it was simulated right before it
+    loop->threading = GameLoop::singleThread;
+    runStart = now;
+    pressed = false;
+    acked = false;
+    nextPressTime = now + MIN_GAP;
+    latencies.clear();
+    ticks.clear();
+}
+
+void LatencySweep::endRun()
+{
+    const Run &run = runs[currentRun];
+    for(size_t i = 0; i < latencies.size(); i++)
+        output << run.updateRate << "," << run.drawTime << "," << DisplayWindow::syncModeNames[run.syncMode] << ","
+            << GameLoop::inputLagMitigationNames[run.mitigation] << "," << GameLoop::timestepNames[run.timestep] << ","
+            << run.repetition << "," << i << "," << latencies[i] << "," << ticks[i] << "\n";
+    output.flush();
+
+    std::cout << run.updateRate << " Hz, draw " << run.drawTime << ", V-Sync " << DisplayWindow::syncModeNames[run.syncMode]
+        << ", " << GameLoop::inputLagMitigationNames[run.mitigation] << ", " << GameLoop::timestepNames[run.timestep]
+        << " #" << run.repetition << ": ";
+    if(latencies.empty())
+    {
+        std::cout << "no samples" << std::endl;
+        return;
+    }
+    std::vector<int64_t> sorted = latencies;
+    std::sort(sorted.begin(), sorted.end());
+    int64_t total = 0;
+    for(int64_t latency : latencies) total += latency;
+    uint32_t totalTicks = 0;
+    for(uint32_t t : ticks) totalTicks += t;
+    std::cout << latencies.size() << " samples, mean " << total / static_cast<int64_t>(latencies.size())
+        << " µs, p50 " << sorted[sorted.size() / 2] << " µs, p99 " << sorted[sorted.size() * 99 / 100] << " µs, "
+        << static_cast<float>(totalTicks) / ticks.size() << " ticks" << std::endl;
+}
+
+LatencySweep::Step LatencySweep::afterFrame()
+{
+    int64_t now = TimeSource::getTimeMicroseconds();
+
+    // The press has been consumed by this frame, which is now swapped
+    if(pressed && !acked)
+    {
+        if(now - runStart >= config.warmup)
+        {
+            latencies.push_back(now - pressTime);
+            ticks.push_back(loop->getNbTicks() - pressTicks);
+        }
+        acked = true;
+        releaseTime = now + HOLD_TIME;
+    }
+
+    if(now - runStart < config.warmup + config.duration) return running;
+    endRun();
+    if(++currentRun >= runs.size())
+    {
+        output.close();
+        return done;
+    }
+    startRun(now);
+    return nextConfig;
+}
+
+Inputs::State LatencySweep::getState()
+{
+    int64_t now = TimeSource::getTimeMicroseconds();
+    if(!pressed && now >= nextPressTime)
+    {
+        pressed = true;
+        // When it was due rather than when polled, the polling delay is part of the lag measured
+        pressTime = nextPressTime;
+        pressTicks = loop->getNbTicks();
+    }
+    else if(pressed && acked && now >= releaseTime)
+    {
+        // Irregular gaps, so presses don't stay in phase with the display
+        pressed = false;
+        acked = false;
+        random = random * 1103515245 + 12345;
+        nextPressTime = now + MIN_GAP + (random >> 16) % (MAX_GAP - MIN_GAP);
+    }
+    Inputs::State ret;
+    ret.x = 0;
+    ret.y = 0;
+    ret.pressAge = 0;
+    ret.pressed = pressed;
+    ret.ack0 = acked;
+    ret.ack1 = acked;
+    ret.reset = false;
+    return ret;
+}
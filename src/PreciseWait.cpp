@@ -0,0 +1,86 @@
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#ifdef __linux__
+#include <cerrno>
+#include <time.h>
+#endif
+#include "PreciseWait.hpp"
+#include "TimeSource.hpp"
+
+PreciseWait::PreciseWait()
+{
+    resetStats();
+}
+
+uint8_t PreciseWait::getBucket(int64_t error)
+{
+    uint8_t bucket = 0;
+    for(int64_t e = std::max<int64_t>(error, 0) + 1; e > 1 && bucket < NB_BUCKETS - 1; e >>= 1) bucket++;
+    return bucket;
+}
+
+void PreciseWait::addSample(int64_t oversleep)
+{
+    samples[currentSample] = static_cast<int32_t>(std::min<int64_t>(oversleep, INT32_MAX));
+    ++currentSample %= NB_SAMPLES;
+    if(nbSamples < NB_SAMPLES) nbSamples++;
+    if(++samplesSinceRecompute < RECOMPUTE_PERIOD) return;
+
+    // Spin for the oversleep that is not exceeded by the target proportion of sleeps
+    samplesSinceRecompute = 0;
+    std::array<int32_t, NB_SAMPLES> sorted = samples;
+    uint8_t index = static_cast<uint8_t>(std::min<float>(nbSamples * percentile, nbSamples - 1.f));
+    std::nth_element(sorted.begin(), sorted.begin() + index, sorted.begin() + nbSamples);
+    margin = sorted[index] > MIN_MARGIN ? sorted[index] : MIN_MARGIN;
+}
+
+void PreciseWait::waitUntil(int64_t deadline)
+{
+    int64_t start = TimeSource::getTimeMicroseconds();
+    if(start >= deadline) return;
+    int64_t sleepTarget = deadline - margin;
+    int64_t woken = start;
+    // Shorter waits only spin and leave the margin as measured, a later long wait still needs all of it
+    if(sleepTarget > start)
+    {
+#ifdef __linux__
+        // Absolute deadline, so a late wake-up doesn't delay the next ones
+        int64_t monotonicTarget = TimeSource::toMonotonicNanoseconds(sleepTarget * 1000);
+        timespec ts;
+        ts.tv_sec = static_cast<time_t>(monotonicTarget / 1000000000);
+        ts.tv_nsec = static_cast<long>(monotonicTarget % 1000000000);
+        while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR);
+#else
+        std::this_thread::sleep_for(std::chrono::microseconds(sleepTarget - start));
+#endif
+        woken = TimeSource::getTimeMicroseconds();
+        addSample(woken - sleepTarget);
+        stats.oversleep[getBucket(woken - sleepTarget)]++;
+        stats.totalSleep += woken - start;
+    }
+    int64_t end = woken;
+    while(end < deadline) end = TimeSource::getTimeMicroseconds();
+    stats.lateness[getBucket(end - deadline)]++;
+    stats.totalSpin += end - woken;
+    stats.nbWaits++;
+}
+
+int64_t PreciseWait::getMargin() const
+{
+    return margin;
+}
+
+const PreciseWait::Stats& PreciseWait::getStats() const
+{
+    return stats;
+}
+
+void PreciseWait::resetStats()
+{
+    stats.oversleep.fill(0);
+    stats.lateness.fill(0);
+    stats.nbWaits = 0;
+    stats.totalSleep = 0;
+    stats.totalSpin = 0;
+}
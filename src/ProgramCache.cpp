@@ -0,0 +1,108 @@
+#ifdef _WINDOWS
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+#include "ProgramCache.hpp"
+#include "MappedFile.hpp"
+#include "Hash.hpp"
+
+ProgramCache programCache;
+
+bool ProgramCache::isSupported()
+{
+    if(supported < 0)
+    {
+        GLint nbFormats = 0;
+        if(GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary) glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &nbFormats);
+        supported = nbFormats > 0;
+        // Binaries only load on the same driver, and an update may change them without an error
+        for(GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION})
+        {
+            const GLubyte *value = glGetString(name);
+            if(value) driver += reinterpret_cast<const char*>(value);
+            driver += '\n';
+        }
+    }
+    return supported;
+}
+
+std::string ProgramCache::getPath(uint64_t key) const
+{
+    char name[24];
+    snprintf(name, sizeof(name), "/%016llx.bin", static_cast<unsigned long long>(key));
+    return directory + name;
+}
+
+uint64_t ProgramCache::getKey(const std::string &vertSource, const std::string &fragSource)
+{
+    isSupported();
+    uint64_t vertSize = vertSource.size();
+    uint64_t key = hashBytes(driver.data(), driver.size());
+    key = hashBytes(&vertSize, sizeof(vertSize), key);
+    key = hashBytes(vertSource.data(), vertSource.size(), key);
+    return hashBytes(fragSource.data(), fragSource.size(), key);
+}
+
+GLuint ProgramCache::load(uint64_t key)
+{
+    if(!enabled || !isSupported()) return 0;
+    MappedFile file;
+    GLenum format;
+    if(!file.open(getPath(key).c_str()) || file.getSize() <= sizeof(format)) return 0;
+    memcpy(&format, file.getData(), sizeof(format));
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, format, file.getData() + sizeof(format),
+            static_cast<GLsizei>(file.getSize() - sizeof(format)));
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if(!linked)
+    {
+        // Compiled again and saved over it
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+void ProgramCache::prepare(GLuint program)
+{
+    if(enabled && isSupported()) glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+void ProgramCache::save(uint64_t key, GLuint program)
+{
+    if(!enabled || !isSupported()) return;
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if(length <= 0) return;
+    GLenum format;
+    std::vector<char> data(sizeof(format) + length);
+    glGetProgramBinary(program, length, &length, &format, &data[sizeof(format)]);
+    memcpy(data.data(), &format, sizeof(format));
+#ifdef _WINDOWS
+    _mkdir(directory.c_str());
+#else
+    mkdir(directory.c_str(), 0755);
+#endif
+    std::ofstream out(getPath(key), std::ios::binary | std::ios::trunc);
+    if(!out.write(data.data(), sizeof(format) + length))
+        std::cerr << "Can't write program binary to " << getPath(key) << std::endl;
+}
+
+void ProgramCache::addProgram(bool cached, int64_t time)
+{
+    stats.nbPrograms++;
+    if(cached) stats.nbCached++;
+    stats.time += time;
+}
+
+const ProgramCache::Stats& ProgramCache::getStats() const
+{
+    return stats;
+}
@@ -1,10 +1,18 @@
 #include "Renderer.hpp"
-#include "SDL2/SDL_image.h"
+#include "SpriteBatch.hpp"
+#include "ProgramCache.hpp"
+#include "TextureLoader.hpp"
+#include "TimeSource.hpp"
 #include <iostream>
+#include <fstream>
+#include <iterator>
+#include <string>
 #include <chrono>
 
 Renderer renderer;
 
+constexpr Renderer::Color Renderer::WHITE;
+
 void Renderer::init()
 {
     window = SDL_CreateWindow("Render context window", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
@@ -34,19 +42,14 @@ void Renderer::init()
     textureProgram = Renderer::loadShaders("assets/basic_texture.vert", "assets/basic_texture_rgba.frag");
     glUseProgram(textureProgram);
     glUniform1i(glGetUniformLocation(textureProgram, "tex"), 0);
-    glGenBuffers(1, &textureVbo);
     glGenVertexArrays(1, &textureVao);
     glBindVertexArray(textureVao);
-    glBindBuffer(GL_ARRAY_BUFFER, textureVbo);
-    {
-        GLuint attrib = glGetAttribLocation(textureProgram ,"pos");
-        glVertexAttribPointer(attrib, 2, GL_FLOAT, false, 16, (void*)0);
-        glEnableVertexAttribArray(attrib);
-        attrib = glGetAttribLocation(textureProgram ,"textureCoord");
-        glVertexAttribPointer(attrib, 2, GL_FLOAT, false, 16, (void*)8);
-        glEnableVertexAttribArray(attrib);
-        glBindFragDataLocation(textureProgram, 0, "fragPass");
-    }
+    // Pointed into the stream buffer at each draw
+    texturePosAttrib = glGetAttribLocation(textureProgram ,"pos");
+    glEnableVertexAttribArray(texturePosAttrib);
+    textureCoordAttrib = glGetAttribLocation(textureProgram ,"textureCoord");
+    glEnableVertexAttribArray(textureCoordAttrib);
+    glBindFragDataLocation(textureProgram, 0, "fragPass");
 
     // Long drawing
     longProgram = Renderer::loadShaders("assets/long_rendering.vert", "assets/long_rendering.frag");
@@ -69,8 +72,31 @@ void Renderer::init()
         glBindFragDataLocation(textureProgram, 0, "fragColor");
 
     }
+
+    // Rects, one instance each
+    instancing = GLEW_VERSION_3_3 || GLEW_ARB_instanced_arrays;
+    if(!instancing) std::cerr << "No instanced arrays, rects are drawn with clears and sprites not at all" << std::endl;
+    rectProgram = Renderer::loadShaders("assets/rect.vert", "assets/rect.frag");
+    glUseProgram(rectProgram);
+    glUniform2f(glGetUniformLocation(rectProgram, "resolution"), NATIVE_RES_X, NATIVE_RES_Y);
+    glGenVertexArrays(1, &rectVao);
+    glBindVertexArray(rectVao);
+    rectAttrib = glGetAttribLocation(rectProgram, "rect");
+    rectColorAttrib = glGetAttribLocation(rectProgram, "color");
+    if(instancing)
+    {
+        setInstanceDivisor(rectAttrib);
+        glEnableVertexAttribArray(rectAttrib);
+        setInstanceDivisor(rectColorAttrib);
+        glEnableVertexAttribArray(rectColorAttrib);
+    }
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
+    stream.init(1 << 20);
+    if(!stream.isPersistent()) std::cerr << "No buffer storage, vertices are streamed by orphaning" << std::endl;
+    if(instancing) spriteBatch.init();
+    gpuTimer.init();
+    gl.invalidate();
     err=glGetError();
     if(err)
         std::cerr << "Error init renderer" << gluErrorString(err) << std::endl;
@@ -85,49 +111,83 @@ void Renderer::beginDrawFrame(GLsync sync)
 {
     SDL_GL_MakeCurrent(window, context);
     glWaitSync(sync, 0, GL_TIMEOUT_IGNORED);
-    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-    glViewport(0, 0, NATIVE_RES_X, NATIVE_RES_Y);
-    glScissor(0, 0, NATIVE_RES_X, NATIVE_RES_Y);
-    glClearColor(0, 0, 0, 0);
+    // Before the scene draws, so the images decoded meanwhile show this frame
+    textureLoader.update();
+    gl.bindFramebuffer(fbo);
+    gl.viewport(0, 0, NATIVE_RES_X, NATIVE_RES_Y);
+    gl.scissor(0, 0, NATIVE_RES_X, NATIVE_RES_Y);
+    gl.clearColor(0, 0, 0, 0);
     glClear(GL_COLOR_BUFFER_BIT);
 }
 
 void Renderer::endDrawFrame()
 {
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    flushRects();
+    spriteBatch.endFrame();
+    stream.endFrame();
+    gl.endFrame();
 }
 
-GLuint Renderer::loadTexture(const char* path)
+void Renderer::rect(int16_t x0, int16_t y0, int16_t x1, int16_t y1, Color color)
 {
-    SDL_Surface *surface = IMG_Load(path);
-    GLuint ret;
-    glGenTextures(1, &ret);
-    glBindTexture(GL_TEXTURE_2D, ret);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8_ALPHA8, surface->w, surface->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, surface->pixels);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    SDL_FreeSurface(surface);
-    return ret;
+    if(!instancing)
+    {
+        clearRect(x0, y0, x1, y1, color);
+        return;
+    }
+    // Rects and sprites keep their order
+    spriteBatch.flush();
+    RectInstance instance = {x0, y0, x1, y1, color};
+    rects.push_back(instance);
 }
 
-void Renderer::rect(int16_t x0, int16_t y0, int16_t x1, int16_t y1)
+void Renderer::clearRect(int16_t x0, int16_t y0, int16_t x1, int16_t y1, Color color)
 {
-    // Unoptimized but short way to draw rectangle.
-    // It should be fast enough for this program.
-    glScissor(x0, y0, x1 - x0 + 1, y1 - y0 + 1);
-    glClearColor(1, 1, 1, 1);
+    flushRects();
+    spriteBatch.flush();
+    gl.scissor(x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+    gl.clearColor(color.r / 255.f, color.g / 255.f, color.b / 255.f, color.a / 255.f);
     glClear(GL_COLOR_BUFFER_BIT);
 }
 
+void Renderer::flushRects()
+{
+    if(rects.empty()) return;
+    int64_t start = TimeSource::getTimeNanoseconds();
+    gl.scissor(0, 0, NATIVE_RES_X, NATIVE_RES_Y);
+    gl.setBlend(false);
+    gl.useProgram(rectProgram);
+    gl.bindVertexArray(rectVao);
+    GLintptr offset = stream.write(rects.data(), rects.size() * sizeof(RectInstance), sizeof(RectInstance));
+    glVertexAttribIPointer(rectAttrib, 4, GL_SHORT, sizeof(RectInstance), reinterpret_cast<void*>(offset));
+    glVertexAttribPointer(rectColorAttrib, 4, GL_UNSIGNED_BYTE, true, sizeof(RectInstance),
+            reinterpret_cast<void*>(offset + 8));
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(rects.size()));
+    nbFlushedRects = static_cast<uint32_t>(rects.size());
+    rects.clear();
+    rectFlushTime = TimeSource::getTimeNanoseconds() - start;
+}
+
+int64_t Renderer::getRectFlushTime() const
+{
+    return rectFlushTime;
+}
+
+uint32_t Renderer::getNbFlushedRects() const
+{
+    return nbFlushedRects;
+}
+
 void Renderer::textureRect(GLuint texture, int16_t x0, int16_t y0, int16_t x1, int16_t y1)
 {
-    glScissor(0, 0, NATIVE_RES_X, NATIVE_RES_Y);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glUseProgram(textureProgram);
-    glBindVertexArray(textureVao);
-    glBindBuffer(GL_ARRAY_BUFFER, textureVbo);
+    flushRects();
+    spriteBatch.flush();
+    gl.scissor(0, 0, NATIVE_RES_X, NATIVE_RES_Y);
+    gl.setBlend(false);
+    gl.activeTexture(GL_TEXTURE0);
+    gl.bindTexture(texture);
+    gl.useProgram(textureProgram);
+    gl.bindVertexArray(textureVao);
     float fx0 = (static_cast<float>(x0) / (NATIVE_RES_X - 1)) * 2 - 1;
     float fy0 = (static_cast<float>(y0) / (NATIVE_RES_Y - 1)) * 2 - 1;
     float fx1 = (static_cast<float>(x1) / (NATIVE_RES_X - 1)) * 2 - 1;
@@ -139,11 +199,10 @@ void Renderer::textureRect(GLuint texture, int16_t x0, int16_t y0, int16_t x1, i
         fx1, fy1, 1, 1,
         fx1, fy0, 1, 0
     };
-    glBufferData(GL_ARRAY_BUFFER, 16 * 4, data, GL_STATIC_DRAW);
+    GLintptr offset = stream.write(data, sizeof(data), 16);
+    glVertexAttribPointer(texturePosAttrib, 2, GL_FLOAT, false, 16, reinterpret_cast<void*>(offset));
+    glVertexAttribPointer(textureCoordAttrib, 2, GL_FLOAT, false, 16, reinterpret_cast<void*>(offset + 8));
     glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-    glBindTexture(GL_TEXTURE_2D, 0);
     int32_t err=glGetError();
     if(err)
         std::cerr << "Error texture rect " << gluErrorString(err) << std::endl;
@@ -151,36 +210,59 @@ void Renderer::textureRect(GLuint texture, int16_t x0, int16_t y0, int16_t x1, i
 
 void Renderer::longDraw(uint16_t instances)
 {
-    glScissor(0, 0, NATIVE_RES_X, NATIVE_RES_Y);
-    glUseProgram(longProgram);
-    glBindVertexArray(longVao);
+    flushRects();
+    spriteBatch.flush();
+    gl.scissor(0, 0, NATIVE_RES_X, NATIVE_RES_Y);
+    gl.setBlend(false);
+    gl.useProgram(longProgram);
+    gl.bindVertexArray(longVao);
     glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, 4, instances);
-    glBindVertexArray(0);
+}
+
+void Renderer::setInstanceDivisor(GLuint attrib)
+{
+    // GLEW only loads the core entry point with 3.3
+    if(GLEW_VERSION_3_3) glVertexAttribDivisor(attrib, 1);
+    else glVertexAttribDivisorARB(attrib, 1);
+}
+
+static std::string readFile(const char *path)
+{
+    std::ifstream in(path, std::ios::binary);
+    if(!in) std::cerr << "Can't read " << path << std::endl;
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
 }
 
 GLuint Renderer::loadShaders(const char* vert, const char* frag)
 {
+    int64_t start = TimeSource::getTimeNanoseconds();
+    std::string vertSource = readFile(vert), fragSource = readFile(frag);
+    uint64_t key = programCache.getKey(vertSource, fragSource);
+    GLuint program = programCache.load(key);
+    if(program)
+    {
+        programCache.addProgram(true, TimeSource::getTimeNanoseconds() - start);
+        return program;
+    }
+
     GLuint vertexShader=glCreateShader(GL_VERTEX_SHADER);
     GLuint fragmentShader=glCreateShader(GL_FRAGMENT_SHADER);
-    GLuint program=glCreateProgram();
+    program=glCreateProgram();
     char buffer[8192];
-    const char* buf=buffer;
+    const char* buf;
     GLint length;
-    FILE* f;
 
-    // Load and compile the vertex shader
-    f = fopen(vert, "rt");
-    length = static_cast<GLint>(fread(buffer, 1, 8192, f));
-    fclose(f);
+    // Compile the vertex shader
+    buf = vertSource.data();
+    length = static_cast<GLint>(vertSource.size());
     glShaderSource(vertexShader,1,&buf,&length);
     glCompileShader(vertexShader);
     glGetShaderInfoLog(vertexShader, 8192,&length,buffer);
     if(length) std::cout << "Vertex shader: " << buffer << std::endl;
 
-    // Load and compile the fragment shader
-    f = fopen(frag, "rt");
-    length = static_cast<GLint>(fread(buffer, 1, 8192, f));
-    fclose(f);
+    // Compile the fragment shader
+    buf = fragSource.data();
+    length = static_cast<GLint>(fragSource.size());
     glShaderSource(fragmentShader,1,&buf,&length);
     glCompileShader(fragmentShader);
     glGetShaderInfoLog(fragmentShader, 8192, &length,buffer);
@@ -189,9 +271,16 @@ GLuint Renderer::loadShaders(const char* vert, const char* frag)
     // Link shaders
     glAttachShader(program,vertexShader);
     glAttachShader(program,fragmentShader);
+    programCache.prepare(program);
     glLinkProgram(program);
     glGetProgramInfoLog(program, 8192, &length,buffer);
     if(length) std::cout << "Link: " << buffer << std::endl;
+    glDetachShader(program, vertexShader);
+    glDetachShader(program, fragmentShader);
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
 
+    programCache.save(key, program);
+    programCache.addProgram(false, TimeSource::getTimeNanoseconds() - start);
     return program;
 }
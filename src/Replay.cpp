@@ -0,0 +1,235 @@
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include "Replay.hpp"
+
+const char Replay::modeNames[Mode::finished + 1][16] =
+{
+    "Off",
+    "Recording",
+    "Playing",
+    "Finished"
+};
+
+constexpr char Replay::MAGIC[5];
+constexpr size_t Replay::HEADER_SIZE;
+constexpr size_t Replay::TICK_SIZE;
+
+// Little endian whatever the machine, so files can be shared
+static void write16(uint8_t *to, uint16_t value)
+{
+    to[0] = static_cast<uint8_t>(value);
+    to[1] = static_cast<uint8_t>(value >> 8);
+}
+
+static uint16_t read16(const uint8_t *from)
+{
+    return static_cast<uint16_t>(from[0] | from[1] << 8);
+}
+
+static void write32(uint8_t *to, uint32_t value)
+{
+    for(int i = 0; i < 4; i++) to[i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+static uint32_t read32(const uint8_t *from)
+{
+    uint32_t value = 0;
+    for(int i = 0; i < 4; i++) value |= static_cast<uint32_t>(from[i]) << (8 * i);
+    return value;
+}
+
+static void write64(uint8_t *to, uint64_t value)
+{
+    for(int i = 0; i < 8; i++) to[i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+static uint64_t read64(const uint8_t *from)
+{
+    uint64_t value = 0;
+    for(int i = 0; i < 8; i++) value |= static_cast<uint64_t>(from[i]) << (8 * i);
+    return value;
+}
+
+Replay::~Replay()
+{
+    stop();
+}
+
+bool Replay::record(const char *path, const Scene &scene, const GameLoop &loop)
+{
+    stop();
+    out.open(path, std::ios::binary | std::ios::trunc);
+    if(!out) return false;
+    snprintf(sceneName, sizeof(sceneName), "%s", scene.getName());
+    updateRate = loop.updateRate;
+    // Loose ticks last as long as the frames, they can't be played again
+    timestep = loop.timestep == GameLoop::loose ? GameLoop::fixed
+            : loop.timestep == GameLoop::looseInterpolation ? GameLoop::interpolation : loop.timestep;
+    this->scene = &scene;
+
+    uint8_t header[HEADER_SIZE] = {0};
+    memcpy(header, MAGIC, 4);
+    header[4] = VERSION;
+    header[5] = static_cast<uint8_t>(timestep);
+    write16(header + 6, static_cast<uint16_t>(updateRate));
+    memcpy(header + 8, sceneName, sizeof(sceneName));
+    out.write(reinterpret_cast<const char*>(header), HEADER_SIZE);
+    nbTicks = tickPos = 0;
+    mode = recording;
+    return true;
+}
+
+bool Replay::play(const char *path)
+{
+    stop();
+    if(!in.open(path)) return false;
+    const uint8_t *data = in.getData();
+    if(in.getSize() < HEADER_SIZE || memcmp(data, MAGIC, 4) || data[4] != VERSION
+            || data[5] > GameLoop::looseInterpolation || !read16(data + 6))
+    {
+        std::cerr << "Not a replay: " << path << std::endl;
+        in.close();
+        return false;
+    }
+    timestep = static_cast<GameLoop::Timestep>(data[5]);
+    updateRate = read16(data + 6);
+    memcpy(sceneName, data + 8, sizeof(sceneName));
+    sceneName[sizeof(sceneName) - 1] = 0;
+    // A recording cut short ends at the last complete tick
+    nbTicks = static_cast<uint32_t>((in.getSize() - HEADER_SIZE) / TICK_SIZE);
+    if(!nbTicks)
+    {
+        std::cerr << "Empty replay: " << path << std::endl;
+        in.close();
+        return false;
+    }
+    tickPos = 0;
+    scene = nullptr;
+    mode = playing;
+    return true;
+}
+
+void Replay::stop()
+{
+    if(mode == recording) out.close();
+    if(mode == playing) in.close();
+    if(mode == recording || mode == playing) mode = finished;
+}
+
+Replay::Mode Replay::getMode() const
+{
+    return mode;
+}
+
+bool Replay::isActive() const
+{
+    return mode == recording || mode == playing;
+}
+
+const char* Replay::getSceneName() const
+{
+    return sceneName;
+}
+
+int Replay::getUpdateRate() const
+{
+    return updateRate;
+}
+
+GameLoop::Timestep Replay::getTimestep() const
+{
+    return timestep;
+}
+
+uint32_t Replay::getNbTicks() const
+{
+    return nbTicks;
+}
+
+uint32_t Replay::getTickPos() const
+{
+    return tickPos;
+}
+
+uint32_t Replay::getNbMismatches() const
+{
+    return nbMismatches;
+}
+
+Inputs::State Replay::beginTick(Inputs::State inputs)
+{
+    if(mode != playing) return inputs;
+    const uint8_t *tick = in.getData() + HEADER_SIZE + static_cast<size_t>(tickPos) * TICK_SIZE;
+    Inputs::State recorded = Inputs::State();
+    recorded.x = static_cast<int16_t>(read16(tick));
+    recorded.y = static_cast<int16_t>(read16(tick + 2));
+    recorded.pressed = tick[4] & 1;
+    recorded.ack0 = (tick[4] >> 1) & 1;
+    recorded.ack1 = (tick[4] >> 2) & 1;
+    recorded.reset = (tick[4] >> 3) & 1;
+    recorded.pressAge = read32(tick + 5);
+    return recorded;
+}
+
+void Replay::endTick(const Scene &scene, Inputs::State inputs)
+{
+    if(!isActive()) return;
+    if(!this->scene) this->scene = &scene;
+    else if(&scene != this->scene)
+    {
+        std::cerr << "Scene changed, replay stopped at tick " << tickPos << std::endl;
+        stop();
+        return;
+    }
+    uint64_t hash = scene.hashState();
+    if(mode == recording)
+    {
+        uint8_t tick[TICK_SIZE];
+        write16(tick, static_cast<uint16_t>(inputs.x));
+        write16(tick + 2, static_cast<uint16_t>(inputs.y));
+        tick[4] = static_cast<uint8_t>(inputs.pressed | inputs.ack0 << 1 | inputs.ack1 << 2 | inputs.reset << 3);
+        write32(tick + 5, inputs.pressAge);
+        write64(tick + 9, hash);
+        out.write(reinterpret_cast<const char*>(tick), TICK_SIZE);
+        nbTicks++;
+    }
+    else if(read64(in.getData() + HEADER_SIZE + static_cast<size_t>(tickPos) * TICK_SIZE + 9) != hash)
+    {
+        if(!nbMismatches) firstMismatch = tickPos;
+        nbMismatches++;
+    }
+    if(++tickPos == nbTicks && mode == playing) stop();
+}
+
+void Replay::addFrame(int64_t frameStart, int64_t updateTime, int64_t drawTime)
+{
+    if(!isActive()) return;
+    if(lastFrameStart) frameTimes.push_back(frameStart - lastFrameStart);
+    lastFrameStart = frameStart;
+    updateTimes.push_back(updateTime);
+    drawTimes.push_back(drawTime);
+}
+
+static void writeTimes(std::ostream &out, const char *name, std::vector<int64_t> times)
+{
+    if(times.empty()) return;
+    std::sort(times.begin(), times.end());
+    int64_t total = 0;
+    for(int64_t time : times) total += time;
+    out << name << "," << total / static_cast<int64_t>(times.size()) << "," << times[times.size() / 2] << ","
+        << times[times.size() * 99 / 100] << "," << times.back() << std::endl;
+}
+
+void Replay::writeSummary(std::ostream &out) const
+{
+    out << "scene,updateRate,timestep,ticks,played,mismatches,firstMismatch" << std::endl;
+    out << sceneName << "," << updateRate << "," << GameLoop::timestepNames[timestep] << "," << nbTicks << ","
+        << tickPos << "," << nbMismatches << "," << (nbMismatches ? static_cast<int64_t>(firstMismatch) : -1)
+        << std::endl;
+    out << "timing,mean,p50,p99,max" << std::endl;
+    writeTimes(out, "frame", frameTimes);
+    writeTimes(out, "update", updateTimes);
+    writeTimes(out, "draw", drawTimes);
+}
@@ -0,0 +1,212 @@
+#include <algorithm>
+#include "Rollback.hpp"
+#include "TimeSource.hpp"
+#include "Telemetry.hpp"
+
+constexpr uint32_t Rollback::NB_SNAPSHOTS;
+constexpr uint32_t Rollback::MAX_PREDICTED;
+constexpr uint8_t Rollback::MAX_PACKET_INPUTS;
+
+static bool sameInputs(const Inputs::State &a, const Inputs::State &b)
+{
+    return a.x == b.x && a.y == b.y && a.pressed == b.pressed && a.ack0 == b.ack0 && a.ack1 == b.ack1
+            && a.reset == b.reset;
+}
+
+Rollback::Rollback(Link &link) : link(link)
+{
+    hashes.fill(0);
+}
+
+Inputs::State Rollback::merge(Inputs::State a, Inputs::State b)
+{
+    Inputs::State merged = Inputs::State();
+    merged.x = static_cast<int16_t>(std::min(std::max(a.x + b.x, -32767), 32767));
+    merged.y = static_cast<int16_t>(std::min(std::max(a.y + b.y, -32767), 32767));
+    // The arrival times are local, they would make the instances diverge
+    merged.pressAge = 0;
+    merged.pressed = a.pressed || b.pressed;
+    merged.ack0 = a.ack0 || b.ack0;
+    merged.ack1 = a.ack1 || b.ack1;
+    merged.reset = a.reset || b.reset;
+    return merged;
+}
+
+void Rollback::reset(Scene &scene)
+{
+    // Both players are expected to pick the same scene, the hash checks tell when they don't
+    this->scene = &scene;
+    stateSize = scene.getStateSize();
+    snapshots.assign(stateSize * NB_SNAPSHOTS, 0);
+    firstTick = currentTick;
+    rollbackTick = UINT32_MAX;
+}
+
+Inputs::State Rollback::getRemoteInputs(uint32_t tick) const
+{
+    if(tick < remoteTick) return remoteInputs[tick % NB_SNAPSHOTS];
+    // Predict the other player keeps holding the same inputs
+    if(remoteTick) return remoteInputs[(remoteTick - 1) % NB_SNAPSHOTS];
+    return Inputs::State();
+}
+
+void Rollback::receive()
+{
+    Packet packet;
+    while(link.receive(packet))
+    {
+        if(packet.magic != PACKET_MAGIC || packet.nbInputs > MAX_PACKET_INPUTS) continue;
+        connected = true;
+        peerAck = std::max(peerAck, packet.ack);
+        peerAdvantage = static_cast<int32_t>(packet.tick - packet.ack);
+        if(packet.hashTick > remoteHashTick)
+        {
+            remoteHashTick = packet.hashTick;
+            remoteHash = packet.hash;
+        }
+        for(uint8_t i = 0; i < packet.nbInputs; i++)
+        {
+            uint32_t tick = packet.firstTick + i;
+            // Older ones are known already, and after a gap the other player resends from our ack
+            if(tick != remoteTick) continue;
+            // Don't overwrite inputs that may still be simulated again
+            if(tick >= currentTick + NB_SNAPSHOTS - MAX_PREDICTED) break;
+            Inputs::State &inputs = remoteInputs[tick % NB_SNAPSHOTS];
+            inputs = Inputs::State();
+            inputs.x = packet.inputs[i].x;
+            inputs.y = packet.inputs[i].y;
+            inputs.pressed = packet.inputs[i].buttons & 1;
+            inputs.ack0 = (packet.inputs[i].buttons >> 1) & 1;
+            inputs.ack1 = (packet.inputs[i].buttons >> 2) & 1;
+            inputs.reset = (packet.inputs[i].buttons >> 3) & 1;
+            if(tick < currentTick && !sameInputs(inputs, usedRemoteInputs[tick % NB_SNAPSHOTS]))
+                rollbackTick = std::min(rollbackTick, tick);
+            remoteTick++;
+        }
+    }
+}
+
+void Rollback::send()
+{
+    Packet packet = Packet();
+    packet.magic = PACKET_MAGIC;
+    packet.tick = currentTick;
+    // Everything the other player misses, as long as it is in the ring
+    packet.firstTick = std::max(peerAck, currentTick > NB_SNAPSHOTS ? currentTick - NB_SNAPSHOTS : 0);
+    packet.nbInputs = static_cast<uint8_t>(std::min<uint32_t>(MAX_PACKET_INPUTS, currentTick - packet.firstTick));
+    packet.ack = remoteTick;
+    packet.hashTick = std::min(currentTick, remoteTick);
+    packet.hash = packet.hashTick ? hashes[(packet.hashTick - 1) % NB_SNAPSHOTS] : 0;
+    for(uint8_t i = 0; i < packet.nbInputs; i++)
+    {
+        const Inputs::State &inputs = localInputs[(packet.firstTick + i) % NB_SNAPSHOTS];
+        packet.inputs[i].x = inputs.x;
+        packet.inputs[i].y = inputs.y;
+        packet.inputs[i].buttons = static_cast<uint8_t>(inputs.pressed | inputs.ack0 << 1 | inputs.ack1 << 2
+                | inputs.reset << 3);
+    }
+    link.send(packet);
+}
+
+void Rollback::simulate(Scene &scene, uint64_t microseconds)
+{
+    uint32_t slot = currentTick % NB_SNAPSHOTS;
+    if(stateSize) scene.copyState(&snapshots[slot * stateSize]);
+    usedRemoteInputs[slot] = getRemoteInputs(currentTick);
+    scene.update(microseconds, merge(localInputs[slot], usedRemoteInputs[slot]));
+    hashes[slot] = scene.hashState();
+    currentTick++;
+}
+
+void Rollback::checkHash()
+{
+    // Only once the tick is final here too, and while its hash is in the ring
+    if(remoteHashTick == checkedHashTick || remoteHashTick > std::min(currentTick, remoteTick)
+            || remoteHashTick <= firstTick || remoteHashTick + NB_SNAPSHOTS <= currentTick)
+        return;
+    checkedHashTick = remoteHashTick;
+    stats.nbChecks++;
+    if(hashes[(remoteHashTick - 1) % NB_SNAPSHOTS] != remoteHash)
+    {
+        if(!stats.nbDesyncs) stats.firstDesync = remoteHashTick - 1;
+        stats.nbDesyncs++;
+    }
+}
+
+void Rollback::poll(Scene &scene, uint64_t microseconds)
+{
+    if(&scene != this->scene) reset(scene);
+    receive();
+    uint32_t from = std::max(rollbackTick, firstTick);
+    rollbackTick = UINT32_MAX;
+    if(stateSize && from < currentTick)
+    {
+        Telemetry::Scope scope(Telemetry::rollback);
+        int64_t start = TimeSource::getTimeNanoseconds();
+        uint32_t depth = currentTick - from;
+        scene.restoreState(&snapshots[(from % NB_SNAPSHOTS) * stateSize]);
+        currentTick = from;
+        for(uint32_t i = 0; i < depth; i++) simulate(scene, microseconds);
+        stats.lastResimTime = TimeSource::getTimeNanoseconds() - start;
+        stats.maxResimTime = std::max(stats.maxResimTime, stats.lastResimTime);
+        stats.totalResimTime += stats.lastResimTime;
+        stats.nbRollbacks++;
+        stats.maxDepth = std::max(stats.maxDepth, depth);
+        stats.totalDepth += depth;
+    }
+    checkHash();
+}
+
+void Rollback::tick(Scene &scene, uint64_t microseconds, Inputs::State inputs)
+{
+    poll(scene, microseconds);
+    // Say hello until the other player answers, then both start from tick 0
+    if(!connected)
+    {
+        send();
+        return;
+    }
+    if(currentTick >= remoteTick + MAX_PREDICTED || currentTick >= peerAck + NB_SNAPSHOTS - MAX_PACKET_INPUTS)
+    {
+        stats.nbWaits++;
+        send();
+        return;
+    }
+    // When this side runs further ahead than the other, give it a tick back now and then
+    int32_t advantage = static_cast<int32_t>(currentTick - remoteTick);
+    if(advantage > peerAdvantage + 1 && currentTick >= nextSkipTick)
+    {
+        nextSkipTick = currentTick + MAX_PREDICTED;
+        stats.nbSkips++;
+        send();
+        return;
+    }
+    localInputs[currentTick % NB_SNAPSHOTS] = inputs;
+    simulate(scene, microseconds);
+    send();
+}
+
+bool Rollback::isConnected() const
+{
+    return connected;
+}
+
+uint32_t Rollback::getTick() const
+{
+    return currentTick;
+}
+
+uint32_t Rollback::getRemoteTick() const
+{
+    return remoteTick;
+}
+
+uint64_t Rollback::getHash(uint32_t tick) const
+{
+    return hashes[tick % NB_SNAPSHOTS];
+}
+
+const Rollback::Stats& Rollback::getStats() const
+{
+    return stats;
+}
@@ -1,11 +1,19 @@
 #include <cstring>
 #include "Scenes/AccurateInputLag.hpp"
 #include "Renderer.hpp"
+#include "Hash.hpp"
 #include "imgui/imgui.h"
 
 AccurateInputLag::AccurateInputLag()
 {
     strcpy(name, "Accurate input lag");
+    visibleTicks.fill(0);
+    visiblePresses.fill(0);
+}
+
+void AccurateInputLag::setRunAhead(uint8_t ticks)
+{
+    runAhead = ticks;
 }
 
 void AccurateInputLag::displayImGuiSettings()
@@ -16,15 +24,23 @@ void AccurateInputLag::displayImGuiSettings()
     {
         ImGui::Text("%d.%d %d.%d ticks", cur.totalFrames0 / cur.presses, (10 * cur.totalFrames0 / cur.presses) % 10,
                 cur.totalFrames1 / cur.presses, (10 * cur.totalFrames1 / cur.presses) % 10);
+        if(cur.totalPressAge)
+            ImGui::Text("Presses sampled %d µs after their arrival", static_cast<int>(cur.totalPressAge / cur.presses));
     }
+    ImGui::DragInt("Built-in lag (ticks)", &lagTicks, 0.1f, 0, MAX_LAG_TICKS);
+    for(uint8_t i = 0; i < NB_RUN_AHEAD; i++) if(visiblePresses[i])
+        ImGui::Text("Run-ahead %d: shown %.1f ticks after the press", i,
+                static_cast<float>(visibleTicks[i]) / visiblePresses[i]);
 }
 
 void AccurateInputLag::update(uint64_t microseconds, Inputs::State inputs)
 {
-    bool prev = cur.display;
-    cur.display = inputs.pressed;
+    bool prev = cur.history & 1;
+    cur.history = static_cast<uint16_t>(cur.history << 1 | inputs.pressed);
+    cur.display = (cur.history >> lagTicks) & 1;
     if(inputs.reset)
     {
+        cur.resets++;
         if (cur.presses)
         {
             cur.lastInputLag0 = static_cast<float>(cur.totalFrames0) / cur.presses;
@@ -33,10 +49,19 @@ void AccurateInputLag::update(uint64_t microseconds, Inputs::State inputs)
         cur.totalFrames0 = 0;
         cur.totalFrames1 = 0;
         cur.presses = 0;
+        cur.totalPressAge = 0;
     }
-    if(cur.display)
+    // From the press rather than from its display, so the built-in lag is measured too
+    if(cur.ticksSincePress < UINT16_MAX) cur.ticksSincePress++;
+    if(inputs.pressed)
     {
-        if(!prev) cur.presses++;
+        if(!prev)
+        {
+            cur.presses++;
+            cur.pressId++;
+            cur.ticksSincePress = 0;
+            cur.totalPressAge += inputs.pressAge;
+        }
         if(!inputs.ack0) cur.totalFrames0++;
         if(!inputs.ack1) cur.totalFrames1++;
     }
@@ -55,7 +80,62 @@ void AccurateInputLag::loadState()
 
 void AccurateInputLag::draw()
 {
-    if(cur.display)
+    draw(cur);
+}
+
+size_t AccurateInputLag::getStateSize() const
+{
+    return sizeof(State);
+}
+
+void AccurateInputLag::copyState(void *to) const
+{
+    memcpy(to, &cur, sizeof(State));
+}
+
+void AccurateInputLag::drawState(const void *state)
+{
+    draw(*static_cast<const State*>(state));
+}
+
+void AccurateInputLag::restoreState(const void *from)
+{
+    memcpy(&cur, from, sizeof(State));
+}
+
+uint64_t AccurateInputLag::hashState() const
+{
+    uint64_t hash = hashBytes(&cur.display, sizeof(cur.display));
+    hash = hashBytes(&cur.history, sizeof(cur.history), hash);
+    hash = hashBytes(&cur.pressId, sizeof(cur.pressId), hash);
+    hash = hashBytes(&cur.ticksSincePress, sizeof(cur.ticksSincePress), hash);
+    hash = hashBytes(&cur.resets, sizeof(cur.resets), hash);
+    hash = hashBytes(&cur.time, sizeof(cur.time), hash);
+    hash = hashBytes(&cur.totalFrames0, sizeof(cur.totalFrames0), hash);
+    hash = hashBytes(&cur.totalFrames1, sizeof(cur.totalFrames1), hash);
+    hash = hashBytes(&cur.presses, sizeof(cur.presses), hash);
+    hash = hashBytes(&cur.totalPressAge, sizeof(cur.totalPressAge), hash);
+    hash = hashBytes(&cur.lastInputLag0, sizeof(cur.lastInputLag0), hash);
+    return hashBytes(&cur.lastInputLag1, sizeof(cur.lastInputLag1), hash);
+}
+
+void AccurateInputLag::draw(const State &state)
+{
+    if(state.resets != lastReset)
+    {
+        lastReset = state.resets;
+        visibleTicks.fill(0);
+        visiblePresses.fill(0);
+    }
+    if(state.display && state.pressId != lastShownPress && state.ticksSincePress >= lagTicks)
+    {
+        // The drawn state may be ahead of the real one
+        lastShownPress = state.pressId;
+        uint8_t ahead = runAhead < NB_RUN_AHEAD ? runAhead : NB_RUN_AHEAD - 1;
+        visibleTicks[ahead] += state.ticksSincePress > runAhead ? state.ticksSincePress - runAhead : 0;
+        visiblePresses[ahead]++;
+    }
+    if(state.display)
     {
         renderer.rect(64, 0, 960, 32);
         renderer.rect(64, 368, 960, 400);
@@ -1,6 +1,8 @@
 #include <algorithm>
+#include <cstring>
 #include "Scenes/GhettoInputLag.hpp"
 #include "Renderer.hpp"
+#include "Hash.hpp"
 #include "imgui/imgui.h"
 
 GhettoInputLag::GhettoInputLag()
@@ -10,6 +12,7 @@ GhettoInputLag::GhettoInputLag()
 
 void GhettoInputLag::displayImGuiSettings()
 {
+    const State &cur = states.cur;
     if(cur.time == 0)
     {
         ImGui::Text("%6d µs", cur.lag);
@@ -18,6 +21,8 @@ void GhettoInputLag::displayImGuiSettings()
 
 void GhettoInputLag::update(uint64_t microseconds, Inputs::State inputs)
 {
+    states.beginTick();
+    State &cur = states.cur;
     if(cur.time == 0)
     {
         if(inputs.pressed && !cur.prevInput) cur.time = BEAT_TIME * (NB_BEATS + 2);
@@ -46,22 +51,67 @@ void GhettoInputLag::update(uint64_t microseconds, Inputs::State inputs)
 
 void GhettoInputLag::saveState()
 {
-    saved = cur;
+    saved = states;
 }
 
 void GhettoInputLag::loadState()
 {
-    cur = saved;
+    states = saved;
 }
 
 void GhettoInputLag::draw()
+{
+    draw(states.cur);
+}
+
+void GhettoInputLag::drawInterpolated(float alpha)
+{
+    // Only the beats move, and not across the start or the end of a measure
+    State state = states.cur;
+    if(states.prev.time && states.cur.time)
+        state.time = TickStates<State>::blend(states.prev.time, states.cur.time, alpha);
+    draw(state);
+}
+
+size_t GhettoInputLag::getStateSize() const
+{
+    return sizeof(State);
+}
+
+void GhettoInputLag::copyState(void *to) const
+{
+    memcpy(to, &states.cur, sizeof(State));
+}
+
+void GhettoInputLag::drawState(const void *state)
+{
+    draw(*static_cast<const State*>(state));
+}
+
+void GhettoInputLag::restoreState(const void *from)
+{
+    memcpy(&states.cur, from, sizeof(State));
+}
+
+uint64_t GhettoInputLag::hashState() const
+{
+    const State &cur = states.cur;
+    // The beats not pressed in this measure still count in the lag of the next one
+    uint64_t hash = hashBytes(cur.diffs.data(), cur.diffs.size() * sizeof(int64_t));
+    hash = hashBytes(&cur.time, sizeof(cur.time), hash);
+    hash = hashBytes(&cur.lag, sizeof(cur.lag), hash);
+    hash = hashBytes(&cur.beat, sizeof(cur.beat), hash);
+    return hashBytes(&cur.prevInput, sizeof(cur.prevInput), hash);
+}
+
+void GhettoInputLag::draw(const State &state)
 {
     renderer.rect(100, 354, 100, 416);
     renderer.rect(99, 322, 101, 353);
     renderer.rect(99, 417, 101, 448);
-    if(cur.time) for(uint8_t i = 0; i < NB_BEATS; i++)
+    if(state.time) for(uint8_t i = 0; i < NB_BEATS; i++)
     {
-        int16_t posX = static_cast<int16_t>(100 + (static_cast<int64_t>(cur.time)
+        int16_t posX = static_cast<int16_t>(100 + (static_cast<int64_t>(state.time)
                 - static_cast<int64_t>(BEAT_TIME * (NB_BEATS - i))) * BEAT_SPEED / static_cast<int64_t>(BEAT_TIME));
         renderer.rect(posX, 354, posX, 416);
     }
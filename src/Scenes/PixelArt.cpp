@@ -1,5 +1,7 @@
 #include "Scenes/PixelArt.hpp"
 #include "Renderer.hpp"
+#include "SpriteBatch.hpp"
+#include "imgui/imgui.h"
 #include <cstring>
 
 PixelArt::PixelArt()
@@ -9,10 +11,39 @@ PixelArt::PixelArt()
 
 void PixelArt::init()
 {
-    texture = renderer.loadTexture("assets/map.png");
+    // Drawn from the first frame it is uploaded
+    map = textureLoader.load("assets/map.png", TextureLoader::sprite);
+}
+
+void PixelArt::displayImGuiSettings()
+{
+    ImGui::DragInt("Sprites", &nbSprites, 10, 0, MAX_SPRITES);
+    ImGui::Text("%u quads in %u draw calls, %d atlas pages", spriteBatch.getNbDrawnQuads(),
+            spriteBatch.getNbDrawCalls(), static_cast<int>(spriteBatch.getNbPages()));
+    ImGui::Text("Map %s in %6d µs%s", textureLoader.getState(map) == TextureLoader::pending ? "loading" : "loaded",
+            static_cast<int>(textureLoader.getLoadTime(map) / 1000),
+            textureLoader.isFromPack(map) ? " from the asset pack" : ", decoded");
+    // The texels sampled shrink as much as the memory
+    ImGui::Text("%s, %u KB instead of %u KB as RGBA", AssetPack::formatNames[textureLoader.getFormat(map)],
+            static_cast<unsigned>(textureLoader.getBytes(map) / 1024),
+            static_cast<unsigned>(textureLoader.getRgbaBytes(map) / 1024));
 }
 
 void PixelArt::draw()
 {
-    renderer.textureRect(texture, 0, 0, NATIVE_RES_X - 1, NATIVE_RES_Y - 1);
+    if(textureLoader.getState(map) != TextureLoader::ready) return;
+    int sprite = textureLoader.getId(map);
+    spriteBatch.draw(sprite, 0, 0, NATIVE_RES_X - 1, NATIVE_RES_Y - 1);
+    uint32_t seed = 1;
+    for(int i = 0; i < nbSprites; i++)
+    {
+        seed = seed * 1664525 + 1013904223;
+        int16_t srcX = static_cast<int16_t>((seed >> 8) % (NATIVE_RES_X / TILE_SIZE) * TILE_SIZE);
+        int16_t srcY = static_cast<int16_t>((seed >> 16) % (NATIVE_RES_Y / TILE_SIZE) * TILE_SIZE);
+        int16_t x = static_cast<int16_t>((seed >> 4) % NATIVE_RES_X);
+        int16_t y = static_cast<int16_t>((seed >> 14) % NATIVE_RES_Y);
+        Renderer::Color color = {255, static_cast<uint8_t>(128 + (seed >> 25)), 255, 224};
+        spriteBatch.draw(sprite, srcX, srcY, TILE_SIZE, TILE_SIZE, x, y, static_cast<int16_t>(x + TILE_SIZE - 1),
+                static_cast<int16_t>(y + TILE_SIZE - 1), color, static_cast<uint8_t>(seed >> 30));
+    }
 }
@@ -0,0 +1,50 @@
+#include <cstring>
+#include "Scenes/RectStress.hpp"
+#include "Renderer.hpp"
+#include "TimeSource.hpp"
+#include "imgui/imgui.h"
+
+RectStress::RectStress()
+{
+    strcpy(name, "Rect stress");
+}
+
+void RectStress::displayImGuiSettings()
+{
+    ImGui::RadioButton("10k", &nbRects, 10000);
+    ImGui::SameLine();
+    ImGui::RadioButton("100k", &nbRects, 100000);
+    ImGui::SameLine();
+    ImGui::RadioButton("1M", &nbRects, 1000000);
+    ImGui::DragInt("Rects", &nbRects, 1000, MIN_RECTS, MAX_RECTS);
+    ImGui::Checkbox("One clear per rect", &useClears);
+    ImGui::Text("Submit %8.1f µs, flush %8.1f µs, frame %8.1f µs", submitTime, flushTime, frameTime);
+    if(frameTime > 0)
+        ImGui::Text("%6.1f Mrects/s, %6.1f ns CPU per rect", nbRects / frameTime,
+                (submitTime + flushTime) * 1000 / nbRects);
+}
+
+void RectStress::draw()
+{
+    int64_t start = TimeSource::getTimeNanoseconds();
+    if(lastDrawTime) frameTime = frameTime * 0.9f + (start - lastDrawTime) / 1000.f * 0.1f;
+    lastDrawTime = start;
+    // The previous frame's batch, flushed after this function returned
+    if(!useClears) flushTime = flushTime * 0.9f + renderer.getRectFlushTime() / 1000.f * 0.1f;
+    else flushTime = 0;
+
+    // Cheap pseudo-random placement, moving a little each frame so no frame is the same
+    uint32_t seed = frame++;
+    for(int i = 0; i < nbRects; i++)
+    {
+        seed = seed * 1664525 + 1013904223;
+        int16_t x = static_cast<int16_t>((seed >> 8) % NATIVE_RES_X);
+        int16_t y = static_cast<int16_t>((seed >> 18) % NATIVE_RES_Y);
+        int16_t size = static_cast<int16_t>(2 + (seed & 7));
+        Renderer::Color color = {static_cast<uint8_t>(seed >> 24), static_cast<uint8_t>(seed >> 16),
+                static_cast<uint8_t>(seed >> 8), 255};
+        if(useClears) renderer.clearRect(x, y, static_cast<int16_t>(x + size), static_cast<int16_t>(y + size), color);
+        else renderer.rect(x, y, static_cast<int16_t>(x + size), static_cast<int16_t>(y + size), color);
+    }
+    submitTime = submitTime * 0.9f + (TimeSource::getTimeNanoseconds() - start) / 1000.f * 0.1f;
+}
@@ -2,6 +2,7 @@
 #include "imgui/imgui.h"
 #include "Scenes/Scrolling.hpp"
 #include "Renderer.hpp"
+#include "Hash.hpp"
 
 Scrolling::Scrolling()
 {
@@ -10,18 +11,19 @@ Scrolling::Scrolling()
 
 void Scrolling::update(uint64_t microseconds, Inputs::State inputs)
 {
-    cur.scrollX += (inputs.x << 16) * static_cast<int64_t>(microseconds) * scrollSpeed / 32767000000;
-    cur.scrollY += (inputs.y << 16) * static_cast<int64_t>(microseconds) * scrollSpeed / 32767000000;
+    states.beginTick();
+    states.cur.scrollX += (inputs.x << 16) * static_cast<int64_t>(microseconds) * scrollSpeed / 32767000000;
+    states.cur.scrollY += (inputs.y << 16) * static_cast<int64_t>(microseconds) * scrollSpeed / 32767000000;
 }
 
 void Scrolling::saveState()
 {
-    saved = cur;
+    saved = states;
 }
 
 void Scrolling::loadState()
 {
-    cur = saved;
+    states = saved;
 }
 
 void Scrolling::displayImGuiSettings()
@@ -30,6 +32,45 @@ void Scrolling::displayImGuiSettings()
 }
 
 void Scrolling::draw()
+{
+    draw(states.cur);
+}
+
+void Scrolling::drawInterpolated(float alpha)
+{
+    State state;
+    state.scrollX = TickStates<State>::blend(states.prev.scrollX, states.cur.scrollX, alpha);
+    state.scrollY = TickStates<State>::blend(states.prev.scrollY, states.cur.scrollY, alpha);
+    draw(state);
+}
+
+size_t Scrolling::getStateSize() const
+{
+    return sizeof(State);
+}
+
+void Scrolling::copyState(void *to) const
+{
+    memcpy(to, &states.cur, sizeof(State));
+}
+
+void Scrolling::drawState(const void *state)
+{
+    draw(*static_cast<const State*>(state));
+}
+
+void Scrolling::restoreState(const void *from)
+{
+    memcpy(&states.cur, from, sizeof(State));
+}
+
+uint64_t Scrolling::hashState() const
+{
+    const State &cur = states.cur;
+    return hashBytes(&cur.scrollY, sizeof(cur.scrollY), hashBytes(&cur.scrollX, sizeof(cur.scrollX)));
+}
+
+void Scrolling::draw(const State &state)
 {
     int sizeX = NATIVE_RES_X + 3 * SQUARES_SIZE - 1;
     sizeX -= (sizeX % SQUARES_SIZE);
@@ -38,11 +79,11 @@ void Scrolling::draw()
     int nbX = sizeX / SQUARES_SIZE, nbY = sizeY / SQUARES_SIZE;
     for(int y = 0; y < nbY; y++) for(int x = y % 2; x < nbX; x += 2)
     {
-        int posX = static_cast<int>(x * SQUARES_SIZE - (cur.scrollX >> 16));
+        int posX = static_cast<int>(x * SQUARES_SIZE - (state.scrollX >> 16));
         posX %= sizeX;
         if(posX < 0) posX += sizeX;
         posX -= SQUARES_SIZE;
-        int posY = static_cast<int>(y * SQUARES_SIZE - (cur.scrollY >> 16));
+        int posY = static_cast<int>(y * SQUARES_SIZE - (state.scrollY >> 16));
         posY %= sizeY;
         if(posY < 0) posY += sizeY;
         posY -= SQUARES_SIZE;
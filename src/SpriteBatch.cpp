@@ -0,0 +1,214 @@
+#include <iostream>
+#include <algorithm>
+#include <initializer_list>
+#include <SDL2/SDL_image.h>
+// ImGui keeps its own copy static
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "SpriteBatch.hpp"
+
+SpriteBatch spriteBatch;
+
+constexpr int SpriteBatch::PAGE_SIZE;
+constexpr int SpriteBatch::PADDING;
+
+void SpriteBatch::init()
+{
+    program = Renderer::loadShaders("assets/sprite.vert", "assets/sprite.frag");
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "tex"), 0);
+    glUniform2f(glGetUniformLocation(program, "resolution"), NATIVE_RES_X, NATIVE_RES_Y);
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    // Pointed into the renderer's stream buffer at each draw
+    rectAttrib = glGetAttribLocation(program, "rect");
+    texRectAttrib = glGetAttribLocation(program, "texRect");
+    colorAttrib = glGetAttribLocation(program, "color");
+    for(GLuint attrib : {rectAttrib, texRectAttrib, colorAttrib})
+    {
+        Renderer::setInstanceDivisor(attrib);
+        glEnableVertexAttribArray(attrib);
+    }
+    glBindVertexArray(0);
+}
+
+// Sprites in compressed pages start and end on whole blocks
+static int getPackUnit(GLenum format)
+{
+    return format == GL_SRGB8_ALPHA8 ? 1 : 4;
+}
+
+SpriteBatch::Page& SpriteBatch::addPage(GLenum format)
+{
+    pages.emplace_back(new Page);
+    Page &page = *pages.back();
+    page.format = format;
+    int size = PAGE_SIZE / getPackUnit(format);
+    page.nodes.resize(size);
+    stbrp_init_target(&page.context, size, size, page.nodes.data(), size);
+    glGenTextures(1, &page.texture);
+    renderer.gl.bindTexture(page.texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    if(format == GL_SRGB8_ALPHA8)
+        glTexImage2D(GL_TEXTURE_2D, 0, format, PAGE_SIZE, PAGE_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    else
+    {
+        // Blocks of 8 bytes for DXT1, 16 for the others
+        GLsizei blockSize = format == GL_COMPRESSED_SRGB_S3TC_DXT1_EXT ? 8 : 16;
+        glCompressedTexImage2D(GL_TEXTURE_2D, 0, format, PAGE_SIZE, PAGE_SIZE, 0,
+                PAGE_SIZE / 4 * PAGE_SIZE / 4 * blockSize, nullptr);
+    }
+    return page;
+}
+
+int SpriteBatch::reserve(int w, int h, GLenum format)
+{
+    if(w <= 0 || h <= 0 || w + PADDING > PAGE_SIZE || h + PADDING > PAGE_SIZE)
+    {
+        std::cerr << "Sprite of " << w << "x" << h << " doesn't fit in a " << PAGE_SIZE << " atlas page" << std::endl;
+        return -1;
+    }
+    int unit = getPackUnit(format);
+    stbrp_rect rect;
+    rect.id = 0;
+    rect.w = static_cast<stbrp_coord>((w + PADDING + unit - 1) / unit);
+    rect.h = static_cast<stbrp_coord>((h + PADDING + unit - 1) / unit);
+    size_t pageIndex = 0;
+    // First page of the format with room, packing one at a time
+    while(pageIndex < pages.size()
+            && (pages[pageIndex]->format != format || !stbrp_pack_rects(&pages[pageIndex]->context, &rect, 1)))
+        pageIndex++;
+    if(pageIndex == pages.size()) stbrp_pack_rects(&addPage(format).context, &rect, 1);
+
+    Sprite sprite = {static_cast<uint16_t>(pageIndex), static_cast<int16_t>(rect.x * unit),
+            static_cast<int16_t>(rect.y * unit), static_cast<int16_t>(w), static_cast<int16_t>(h)};
+    sprites.push_back(sprite);
+    return static_cast<int>(sprites.size() - 1);
+}
+
+void SpriteBatch::upload(int sprite, const uint8_t *pixels, int pitch)
+{
+    const Sprite &target = sprites[sprite];
+    renderer.gl.bindTexture(pages[target.page]->texture);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, pitch / 4);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, target.x, target.y, target.w, target.h, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+}
+
+void SpriteBatch::uploadCompressed(int sprite, const uint8_t *blocks, size_t size)
+{
+    const Sprite &target = sprites[sprite];
+    const Page &page = *pages[target.page];
+    renderer.gl.bindTexture(page.texture);
+    // Whole blocks, the padding reserved keeps them clear of the next sprite
+    glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, target.x, target.y, (target.w + 3) / 4 * 4, (target.h + 3) / 4 * 4,
+            page.format, static_cast<GLsizei>(size), blocks);
+}
+
+int SpriteBatch::add(const uint8_t *pixels, int w, int h, int pitch)
+{
+    int sprite = reserve(w, h);
+    if(sprite >= 0) upload(sprite, pixels, pitch);
+    return sprite;
+}
+
+int SpriteBatch::load(const char *path)
+{
+    SDL_Surface *loaded = IMG_Load(path);
+    if(!loaded)
+    {
+        std::cerr << "Can't load " << path << std::endl;
+        return -1;
+    }
+    SDL_Surface *surface = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_RGBA32, 0);
+    SDL_FreeSurface(loaded);
+    if(!surface) return -1;
+    int sprite = add(static_cast<const uint8_t*>(surface->pixels), surface->w, surface->h, surface->pitch);
+    SDL_FreeSurface(surface);
+    return sprite;
+}
+
+void SpriteBatch::draw(int sprite, int16_t x0, int16_t y0, int16_t x1, int16_t y1, Renderer::Color color, uint8_t flip)
+{
+    const Sprite &source = sprites[sprite];
+    draw(sprite, 0, 0, source.w, source.h, x0, y0, x1, y1, color, flip);
+}
+
+void SpriteBatch::draw(int sprite, int16_t srcX, int16_t srcY, int16_t srcW, int16_t srcH, int16_t x0, int16_t y0,
+        int16_t x1, int16_t y1, Renderer::Color color, uint8_t flip)
+{
+    // Rects and sprites keep their order
+    renderer.flushRects();
+    const Sprite &source = sprites[sprite];
+    Instance instance = {x0, y0, x1, y1, static_cast<int16_t>(source.x + srcX), static_cast<int16_t>(source.y + srcY),
+            static_cast<int16_t>(source.x + srcX + srcW), static_cast<int16_t>(source.y + srcY + srcH), color};
+    if(flip & horizontal) std::swap(instance.u0, instance.u1);
+    if(flip & vertical) std::swap(instance.v0, instance.v1);
+    pages[source.page]->instances.push_back(instance);
+    nbQueued++;
+}
+
+void SpriteBatch::flush()
+{
+    if(!nbQueued) return;
+    // Without instanced arrays there is no program to draw them
+    if(!program)
+    {
+        for(std::unique_ptr<Page> &page : pages) page->instances.clear();
+        nbQueued = 0;
+        return;
+    }
+    GlState &gl = renderer.gl;
+    gl.scissor(0, 0, NATIVE_RES_X, NATIVE_RES_Y);
+    gl.setBlend(true);
+    gl.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    gl.useProgram(program);
+    gl.bindVertexArray(vao);
+    gl.activeTexture(GL_TEXTURE0);
+    for(std::unique_ptr<Page> &page : pages)
+    {
+        if(page->instances.empty()) continue;
+        GLintptr offset = renderer.stream.write(page->instances.data(), page->instances.size() * sizeof(Instance),
+                sizeof(Instance));
+        glVertexAttribIPointer(rectAttrib, 4, GL_SHORT, sizeof(Instance), reinterpret_cast<void*>(offset));
+        glVertexAttribIPointer(texRectAttrib, 4, GL_SHORT, sizeof(Instance), reinterpret_cast<void*>(offset + 8));
+        glVertexAttribPointer(colorAttrib, 4, GL_UNSIGNED_BYTE, true, sizeof(Instance),
+                reinterpret_cast<void*>(offset + 16));
+        gl.bindTexture(page->texture);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(page->instances.size()));
+        frameDrawCalls++;
+        frameQuads += static_cast<uint32_t>(page->instances.size());
+        page->instances.clear();
+    }
+    nbQueued = 0;
+}
+
+bool SpriteBatch::isEmpty() const
+{
+    return !nbQueued;
+}
+
+size_t SpriteBatch::getNbPages() const
+{
+    return pages.size();
+}
+
+void SpriteBatch::endFrame()
+{
+    flush();
+    nbDrawCalls = frameDrawCalls;
+    nbDrawnQuads = frameQuads;
+    frameDrawCalls = frameQuads = 0;
+}
+
+uint32_t SpriteBatch::getNbDrawCalls() const
+{
+    return nbDrawCalls;
+}
+
+uint32_t SpriteBatch::getNbDrawnQuads() const
+{
+    return nbDrawnQuads;
+}
@@ -0,0 +1,150 @@
+#include <iostream>
+#include <cstring>
+#include "StreamBuffer.hpp"
+#include "TimeSource.hpp"
+
+constexpr uint8_t StreamBuffer::NB_REGIONS;
+
+static constexpr GLbitfield PERSISTENT_FLAGS = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+void StreamBuffer::init(size_t regionSize, GLenum target)
+{
+    this->target = target;
+    persistent = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+    create(regionSize);
+}
+
+void StreamBuffer::create(size_t regionSize)
+{
+    this->regionSize = regionSize;
+    GLsizeiptr size = static_cast<GLsizeiptr>(regionSize * NB_REGIONS);
+    glGenBuffers(1, &buffer);
+    glBindBuffer(target, buffer);
+    if(persistent)
+    {
+        glBufferStorage(target, size, nullptr, PERSISTENT_FLAGS);
+        mapping = static_cast<uint8_t*>(glMapBufferRange(target, 0, size, PERSISTENT_FLAGS));
+        if(!mapping)
+        {
+            // The storage can't be orphaned, start again with a mutable one
+            std::cerr << "Persistent mapping failed, streaming by orphaning" << std::endl;
+            glDeleteBuffers(1, &buffer);
+            glGenBuffers(1, &buffer);
+            glBindBuffer(target, buffer);
+            persistent = false;
+        }
+    }
+    if(!persistent) glBufferData(target, size, nullptr, GL_STREAM_DRAW);
+    glBindBuffer(target, 0);
+    region = 0;
+    pos = regionStart = 0;
+}
+
+void StreamBuffer::destroy()
+{
+    for(GLsync &fence : fences)
+    {
+        if(fence) glDeleteSync(fence);
+        fence = 0;
+    }
+    // Draws still reading it keep it alive until they are done
+    if(buffer) glDeleteBuffers(1, &buffer);
+    buffer = 0;
+    mapping = nullptr;
+}
+
+void StreamBuffer::nextRegion()
+{
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    region = (region + 1) % NB_REGIONS;
+    regionStart = pos = region * regionSize;
+    if(!fences[region]) return;
+    int64_t start = TimeSource::getTimeNanoseconds();
+    while(glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED);
+    frameWaitTime += TimeSource::getTimeNanoseconds() - start;
+    glDeleteSync(fences[region]);
+    fences[region] = 0;
+}
+
+uint8_t* StreamBuffer::map(size_t size, size_t alignment, GLintptr &offset)
+{
+    frameBytes += size;
+    if(size + alignment > regionSize)
+    {
+        size_t newSize = regionSize;
+        while(newSize < size + alignment) newSize *= 2;
+        destroy();
+        create(newSize);
+    }
+    glBindBuffer(target, buffer);
+    size_t aligned = (pos + alignment - 1) / alignment * alignment;
+    if(persistent)
+    {
+        if(aligned + size > regionStart + regionSize)
+        {
+            nextRegion();
+            aligned = (pos + alignment - 1) / alignment * alignment;
+        }
+        pos = aligned + size;
+        offset = static_cast<GLintptr>(aligned);
+        return mapping + aligned;
+    }
+    if(aligned + size > regionSize * NB_REGIONS)
+    {
+        glBufferData(target, static_cast<GLsizeiptr>(regionSize * NB_REGIONS), nullptr, GL_STREAM_DRAW);
+        aligned = 0;
+    }
+    pos = aligned + size;
+    offset = static_cast<GLintptr>(aligned);
+    // Only ranges not written since the last orphaning, no need to wait for the GPU
+    return static_cast<uint8_t*>(glMapBufferRange(target, offset, static_cast<GLsizeiptr>(size),
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+}
+
+void StreamBuffer::unmap()
+{
+    if(!persistent) glUnmapBuffer(target);
+}
+
+GLintptr StreamBuffer::write(const void *data, size_t size, size_t alignment)
+{
+    GLintptr offset;
+    uint8_t *to = map(size, alignment, offset);
+    if(to) memcpy(to, data, size);
+    unmap();
+    return offset;
+}
+
+void StreamBuffer::endFrame()
+{
+    if(persistent && pos != regionStart) nextRegion();
+    lastFrameBytes = frameBytes;
+    lastWaitTime = frameWaitTime;
+    frameBytes = 0;
+    frameWaitTime = 0;
+}
+
+GLuint StreamBuffer::getBuffer() const
+{
+    return buffer;
+}
+
+bool StreamBuffer::isPersistent() const
+{
+    return persistent;
+}
+
+size_t StreamBuffer::getSize() const
+{
+    return regionSize * NB_REGIONS;
+}
+
+size_t StreamBuffer::getFrameBytes() const
+{
+    return lastFrameBytes;
+}
+
+int64_t StreamBuffer::getWaitTime() const
+{
+    return lastWaitTime;
+}
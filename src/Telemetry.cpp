@@ -0,0 +1,151 @@
+#include <chrono>
+#include <string>
+#include "Telemetry.hpp"
+#include "TimeSource.hpp"
+
+Telemetry telemetry;
+
+constexpr int Telemetry::FLUSH_PERIOD;
+
+const char Telemetry::phaseNames[Phase::gpuImGui + 1][16] =
+{
+    "Events",
+    "ImGui",
+    "Frame delay",
+    "Update",
+    "Scene draw",
+    "Window draw",
+    "Swap",
+    "GPU hard sync",
+    "Run-ahead",
+    "Rollback",
+    "GPU long draw",
+    "GPU scene draw",
+    "GPU window draw",
+    "GPU ImGui"
+};
+
+Telemetry::Scope::Scope(Phase phase) : phase(phase), start(telemetry.isRecording() ? TimeSource::getTimeNanoseconds() : 0)
+{
+}
+
+Telemetry::Scope::~Scope()
+{
+    if(start) telemetry.record(phase, start, TimeSource::getTimeNanoseconds());
+}
+
+Telemetry::Telemetry() : writeIndex(0), readIndex(0), running(false), dropped(0)
+{
+}
+
+Telemetry::~Telemetry()
+{
+    stop();
+}
+
+bool Telemetry::start(const char *path)
+{
+    if(running) return false;
+    binFile = fopen((std::string(path) + ".bin").c_str(), "wb");
+    jsonFile = fopen((std::string(path) + ".json").c_str(), "wt");
+    if(!binFile || !jsonFile)
+    {
+        if(binFile) fclose(binFile);
+        if(jsonFile) fclose(jsonFile);
+        binFile = jsonFile = nullptr;
+        return false;
+    }
+    FileHeader header = {{'D', 'S', 'R', 'T'}, 1, sizeof(Event)};
+    fwrite(&header, sizeof(header), 1, binFile);
+    fputs("{\"traceEvents\":[\n", jsonFile);
+    firstJsonEvent = true;
+
+    // Allocate everything now, recording must not allocate
+    ring.resize(RING_SIZE);
+    writeIndex = 0;
+    readIndex = 0;
+    dropped = 0;
+    running = true;
+    flushThread = std::thread(&Telemetry::flushLoop, this);
+    return true;
+}
+
+void Telemetry::stop()
+{
+    if(!running) return;
+    running = false;
+    flushThread.join();
+    flush();
+    fputs("\n]}\n", jsonFile);
+    fclose(jsonFile);
+    fclose(binFile);
+    jsonFile = binFile = nullptr;
+}
+
+bool Telemetry::isRecording() const
+{
+    return running.load(std::memory_order_relaxed);
+}
+
+void Telemetry::beginFrame()
+{
+    frame++;
+}
+
+uint32_t Telemetry::getFrame() const
+{
+    return frame;
+}
+
+void Telemetry::record(Phase phase, int64_t start, int64_t end)
+{
+    record(phase, start, end, frame);
+}
+
+void Telemetry::record(Phase phase, int64_t start, int64_t end, uint32_t frame)
+{
+    // Single producer: only the main thread records
+    if(!isRecording()) return;
+    uint32_t write = writeIndex.load(std::memory_order_relaxed);
+    if(write - readIndex.load(std::memory_order_acquire) >= RING_SIZE)
+    {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    Event &event = ring[write & (RING_SIZE - 1)];
+    event.start = start;
+    event.end = end;
+    event.frame = frame;
+    event.phase = phase;
+    writeIndex.store(write + 1, std::memory_order_release);
+}
+
+uint32_t Telemetry::getNbDropped() const
+{
+    return dropped.load(std::memory_order_relaxed);
+}
+
+void Telemetry::flush()
+{
+    uint32_t read = readIndex.load(std::memory_order_relaxed);
+    uint32_t write = writeIndex.load(std::memory_order_acquire);
+    for(; read != write; read++)
+    {
+        const Event &event = ring[read & (RING_SIZE - 1)];
+        fwrite(&event, sizeof(event), 1, binFile);
+        fprintf(jsonFile, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+                "\"args\":{\"frame\":%u}}", firstJsonEvent ? "" : ",\n", phaseNames[event.phase],
+                event.phase >= gpuLongDraw ? 2 : 1, event.start / 1000., (event.end - event.start) / 1000., event.frame);
+        firstJsonEvent = false;
+    }
+    readIndex.store(read, std::memory_order_release);
+}
+
+void Telemetry::flushLoop()
+{
+    while(running.load(std::memory_order_relaxed))
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(FLUSH_PERIOD));
+        flush();
+    }
+}
@@ -0,0 +1,292 @@
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <SDL2/SDL_image.h>
+#include "TextureLoader.hpp"
+#include "Renderer.hpp"
+#include "SpriteBatch.hpp"
+#include "TimeSource.hpp"
+
+TextureLoader textureLoader;
+
+constexpr size_t TextureLoader::UPLOAD_BUDGET;
+constexpr unsigned TextureLoader::MAX_WORKERS;
+
+// Smallest first, then by quality
+static const AssetPack::Format compressedFormats[] = {AssetPack::bc1, AssetPack::bc7, AssetPack::etc2, AssetPack::bc3};
+
+static bool isSupported(AssetPack::Format format)
+{
+    switch(format)
+    {
+        case AssetPack::bc1:
+        case AssetPack::bc3:
+            // The sRGB variants come with EXT_texture_sRGB
+            return GLEW_EXT_texture_compression_s3tc && GLEW_EXT_texture_sRGB;
+        case AssetPack::bc7:
+            return GLEW_VERSION_4_2 || GLEW_ARB_texture_compression_bptc;
+        case AssetPack::etc2:
+            return GLEW_VERSION_4_3 || GLEW_ARB_ES3_compatibility;
+        default:
+            return true;
+    }
+}
+
+static GLenum getGlFormat(AssetPack::Format format)
+{
+    switch(format)
+    {
+        case AssetPack::bc1:
+            return GL_COMPRESSED_SRGB_S3TC_DXT1_EXT;
+        case AssetPack::bc3:
+            return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+        case AssetPack::bc7:
+            return GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM;
+        case AssetPack::etc2:
+            return GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC;
+        default:
+            return GL_SRGB8_ALPHA8;
+    }
+}
+
+TextureLoader::~TextureLoader()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+    for(std::thread &worker : workers) worker.join();
+    for(Request &request : requests) if(request.surface) SDL_FreeSurface(request.surface);
+}
+
+TextureLoader::Handle TextureLoader::load(const char *path, Target target)
+{
+    Handle handle;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(!packOpened)
+        {
+            packOpened = true;
+            if(usePack && !pack.open(packPath.c_str()))
+                std::cerr << "No asset pack at " << packPath << ", decoding the images" << std::endl;
+        }
+        Request request = {};
+        request.path = path;
+        request.target = target;
+        request.id = -1;
+        request.start = TimeSource::getTimeNanoseconds();
+        if(!stats.firstStart) stats.firstStart = request.start;
+        const AssetPack::Entry *entry = nullptr;
+        if(useCompression) for(AssetPack::Format format : compressedFormats)
+            if(!entry && isSupported(format)) entry = pack.find(path, format);
+        if(!entry) entry = pack.find(path, AssetPack::rgba8);
+        if(entry)
+        {
+            request.pixels = pack.getData(*entry);
+            request.format = static_cast<AssetPack::Format>(entry->format);
+            request.w = entry->w;
+            request.h = entry->h;
+            request.pitch = entry->w * 4;
+            request.size = entry->size;
+            request.fromPack = true;
+        }
+        requests.push_back(request);
+        handle = static_cast<Handle>(requests.size() - 1);
+        if(request.fromPack)
+        {
+            toUpload.push_back(&requests.back());
+            return handle;
+        }
+        // Started with the first image to decode, nothing runs for the scenes without any
+        if(workers.empty())
+        {
+            unsigned nbWorkers = std::max(1u, std::min(MAX_WORKERS, std::thread::hardware_concurrency() / 2));
+            for(unsigned i = 0; i < nbWorkers; i++) workers.emplace_back(&TextureLoader::decode, this);
+        }
+        toDecode.push_back(&requests.back());
+    }
+    wakeUp.notify_one();
+    return handle;
+}
+
+void TextureLoader::decode()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while(true)
+    {
+        wakeUp.wait(lock, [this] { return stopping || !toDecode.empty(); });
+        if(stopping) return;
+        Request &request = *toDecode.front();
+        toDecode.pop_front();
+        lock.unlock();
+
+        int64_t start = TimeSource::getTimeNanoseconds();
+        SDL_Surface *loaded = IMG_Load(request.path.c_str());
+        SDL_Surface *surface = loaded ? SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_RGBA32, 0) : nullptr;
+        if(loaded) SDL_FreeSurface(loaded);
+        if(!surface) std::cerr << "Can't load " << request.path << std::endl;
+
+        int64_t decodeTime = TimeSource::getTimeNanoseconds() - start;
+
+        lock.lock();
+        stats.decodeTime += decodeTime;
+        request.surface = surface;
+        if(surface)
+        {
+            request.pixels = static_cast<const uint8_t*>(surface->pixels);
+            request.w = surface->w;
+            request.h = surface->h;
+            request.pitch = surface->pitch;
+            request.size = AssetPack::getDataSize(AssetPack::rgba8, surface->w, surface->h);
+            toUpload.push_back(&request);
+        }
+        else request.state = failed;
+    }
+}
+
+void TextureLoader::upload(Request &request)
+{
+    bool compressed = request.format != AssetPack::rgba8;
+    GLenum format = getGlFormat(request.format);
+    // Before binding the pixel buffer, a new atlas page is allocated empty
+    if(request.target == sprite) request.id = spriteBatch.reserve(request.w, request.h, format);
+    else
+    {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        renderer.gl.bindTexture(texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        request.id = static_cast<int>(texture);
+    }
+    if(request.id < 0) return;
+
+    size_t rowSize = static_cast<size_t>(request.w) * 4;
+    GLintptr offset;
+    uint8_t *to = uploads.map(request.size, 16, offset);
+    if(to && compressed) memcpy(to, request.pixels, request.size);
+    else if(to) for(int y = 0; y < request.h; y++)
+        memcpy(to + y * rowSize, request.pixels + y * request.pitch, rowSize);
+    uploads.unmap();
+    if(!to)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        request.id = -1;
+        return;
+    }
+    // An offset in the bound pixel buffer, the copy to the texture doesn't wait for the GPU
+    const uint8_t *pixels = reinterpret_cast<const uint8_t*>(offset);
+    if(request.target == sprite && compressed) spriteBatch.uploadCompressed(request.id, pixels, request.size);
+    else if(request.target == sprite) spriteBatch.upload(request.id, pixels, static_cast<int>(rowSize));
+    else
+    {
+        renderer.gl.bindTexture(static_cast<GLuint>(request.id));
+        if(compressed) glCompressedTexImage2D(GL_TEXTURE_2D, 0, format, request.w, request.h, 0,
+                static_cast<GLsizei>(request.size), pixels);
+        else glTexImage2D(GL_TEXTURE_2D, 0, format, request.w, request.h, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    }
+    // Or every other upload would read from it
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void TextureLoader::update()
+{
+    std::vector<Request*> batch;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t size = 0;
+        while(!toUpload.empty())
+        {
+            const Request &request = *toUpload.front();
+            size += request.size;
+            if(!batch.empty() && size > UPLOAD_BUDGET) break;
+            batch.push_back(toUpload.front());
+            toUpload.pop_front();
+        }
+    }
+    if(batch.empty()) return;
+
+    if(!uploads.getBuffer()) uploads.init(4 << 20, GL_PIXEL_UNPACK_BUFFER);
+    for(Request *request : batch) upload(*request);
+    uploads.endFrame();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for(Request *request : batch)
+    {
+        if(request->surface) SDL_FreeSurface(request->surface);
+        request->surface = nullptr;
+        request->pixels = nullptr;
+        request->state = request->id < 0 ? failed : ready;
+        request->readyTime = TimeSource::getTimeNanoseconds();
+        stats.nbLoaded++;
+        if(request->fromPack) stats.nbFromPack++;
+        stats.uploadedBytes += request->size;
+        stats.rgbaBytes += AssetPack::getDataSize(AssetPack::rgba8, request->w, request->h);
+        stats.lastReady = request->readyTime;
+    }
+}
+
+bool TextureLoader::isValid(Handle handle) const
+{
+    return handle >= 0 && static_cast<size_t>(handle) < requests.size();
+}
+
+TextureLoader::State TextureLoader::getState(Handle handle)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return isValid(handle) ? requests[handle].state : failed;
+}
+
+int TextureLoader::getId(Handle handle)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return isValid(handle) ? requests[handle].id : -1;
+}
+
+int64_t TextureLoader::getLoadTime(Handle handle)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if(!isValid(handle)) return 0;
+    const Request &request = requests[handle];
+    return request.readyTime ? request.readyTime - request.start : TimeSource::getTimeNanoseconds() - request.start;
+}
+
+uint32_t TextureLoader::getNbPending()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    uint32_t nbPending = 0;
+    for(const Request &request : requests) if(request.state == pending) nbPending++;
+    return nbPending;
+}
+
+bool TextureLoader::isFromPack(Handle handle)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return isValid(handle) && requests[handle].fromPack;
+}
+
+AssetPack::Format TextureLoader::getFormat(Handle handle)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return isValid(handle) ? requests[handle].format : AssetPack::rgba8;
+}
+
+size_t TextureLoader::getBytes(Handle handle)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return isValid(handle) ? requests[handle].size : 0;
+}
+
+size_t TextureLoader::getRgbaBytes(Handle handle)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if(!isValid(handle)) return 0;
+    return AssetPack::getDataSize(AssetPack::rgba8, requests[handle].w, requests[handle].h);
+}
+
+TextureLoader::Stats TextureLoader::getStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
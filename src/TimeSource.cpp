@@ -0,0 +1,184 @@
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#ifdef __linux__
+#include <time.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#include <cpuid.h>
+#define HAS_TSC
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define HAS_TSC
+#endif
+#include "TimeSource.hpp"
+
+const char TimeSource::backendNames[Backend::tsc + 1][16] =
+{
+    "monotonic",
+    "monotonic-raw",
+    "tsc"
+};
+
+TimeSource::Backend TimeSource::backend = TimeSource::monotonic;
+int64_t TimeSource::tscBase = 0, TimeSource::nsBase = 0;
+double TimeSource::nsPerTick = 0;
+
+int64_t TimeSource::readBackend(Backend backend)
+{
+    switch(backend)
+    {
+#ifdef HAS_TSC
+        case tsc:
+            return nsBase + static_cast<int64_t>(static_cast<int64_t>(__rdtsc() - tscBase) * nsPerTick);
+#endif
+#ifdef __linux__
+        case monotonicRaw:
+        {
+            timespec ts;
+            clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+            return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+        }
+        default:
+        {
+            timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+        }
+#else
+        default:
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+}
+
+void TimeSource::calibrateTsc()
+{
+#ifdef HAS_TSC
+    // Long enough for the OS clock granularity to be negligible
+    int64_t ns0 = readBackend(monotonic);
+    uint64_t tsc0 = __rdtsc();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    int64_t ns1 = readBackend(monotonic);
+    uint64_t tsc1 = __rdtsc();
+    nsPerTick = static_cast<double>(ns1 - ns0) / static_cast<double>(tsc1 - tsc0);
+    tscBase = static_cast<int64_t>(tsc1);
+    nsBase = ns1;
+#endif
+}
+
+bool TimeSource::isAvailable(Backend backend)
+{
+    switch(backend)
+    {
+        case monotonic:
+            return true;
+        case monotonicRaw:
+#ifdef __linux__
+            return true;
+#else
+            return false;
+#endif
+        case tsc:
+        {
+            // Only an invariant TSC ticks at a constant rate across frequency changes and sleep states
+#if defined(HAS_TSC) && defined(_MSC_VER)
+            int regs[4];
+            __cpuid(regs, 0x80000000);
+            if(static_cast<unsigned int>(regs[0]) < 0x80000007) return false;
+            __cpuid(regs, 0x80000007);
+            return regs[3] & (1 << 8);
+#elif defined(HAS_TSC)
+            unsigned int eax, ebx, ecx, edx;
+            if(!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) return false;
+            return edx & (1 << 8);
+#else
+            return false;
+#endif
+        }
+        default:
+            return false;
+    }
+}
+
+bool TimeSource::select(Backend backend)
+{
+    if(!isAvailable(backend)) return false;
+    if(backend == tsc) calibrateTsc();
+    TimeSource::backend = backend;
+    return true;
+}
+
+TimeSource::Backend TimeSource::getBackend()
+{
+    return backend;
+}
+
+int64_t TimeSource::getTimeNanoseconds()
+{
+    return readBackend(backend);
+}
+
+int64_t TimeSource::getTimeMicroseconds()
+{
+    return readBackend(backend) / 1000;
+}
+
+int64_t TimeSource::toMonotonicNanoseconds(int64_t nanoseconds)
+{
+    if(backend == monotonic) return nanoseconds;
+    return readBackend(monotonic) + nanoseconds - readBackend(backend);
+}
+
+int64_t TimeSource::fromMonotonicNanoseconds(int64_t nanoseconds)
+{
+    if(backend == monotonic) return nanoseconds;
+    return readBackend(backend) + nanoseconds - readBackend(monotonic);
+}
+
+void TimeSource::runBenchmark(std::ostream &out)
+{
+    static constexpr int NB_READS = 1000000;
+    static constexpr int DRIFT_TIME = 2000; // ms
+
+    Backend selected = backend;
+    if(isAvailable(tsc)) calibrateTsc();
+    int64_t start[Backend::tsc + 1], end[Backend::tsc + 1];
+
+    out << "backend,readCost(ns),resolution(ns),drift(ppm)" << std::endl;
+    for(int8_t b = monotonic; b <= tsc; b++) if(isAvailable(static_cast<Backend>(b)))
+        start[b] = readBackend(static_cast<Backend>(b));
+    std::this_thread::sleep_for(std::chrono::milliseconds(DRIFT_TIME));
+    for(int8_t b = monotonic; b <= tsc; b++) if(isAvailable(static_cast<Backend>(b)))
+        end[b] = readBackend(static_cast<Backend>(b));
+
+    for(int8_t b = monotonic; b <= tsc; b++)
+    {
+        Backend current = static_cast<Backend>(b);
+        if(!isAvailable(current)) continue;
+
+        // Read cost, measured with the monotonic clock around many reads
+        volatile int64_t sink;
+        int64_t before = readBackend(monotonic);
+        for(int i = 0; i < NB_READS; i++) sink = readBackend(current);
+        int64_t after = readBackend(monotonic);
+        (void)sink;
+
+        // Resolution, smallest non-zero step between two reads
+        int64_t resolution = INT64_MAX;
+        for(int i = 0; i < 1000; i++)
+        {
+            int64_t t0 = readBackend(current), t1;
+            do t1 = readBackend(current); while(t1 == t0);
+            resolution = std::min(resolution, t1 - t0);
+        }
+
+        double elapsed = static_cast<double>(end[monotonic] - start[monotonic]);
+        double drift = (static_cast<double>(end[b] - start[b]) - elapsed) / elapsed * 1e6;
+        out << backendNames[b] << "," << static_cast<double>(after - before) / NB_READS << "," << resolution << ","
+            << drift << std::endl;
+    }
+    select(selected);
+}
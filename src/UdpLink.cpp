@@ -0,0 +1,122 @@
+#include <iostream>
+#include <cstring>
+#ifdef _WINDOWS
+#include <winsock2.h>
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "UdpLink.hpp"
+#include "TimeSource.hpp"
+
+UdpLink::~UdpLink()
+{
+    close();
+}
+
+bool UdpLink::open(uint16_t localPort, uint16_t remotePort)
+{
+    close();
+#ifdef _WINDOWS
+    WSADATA wsaData;
+    if(WSAStartup(MAKEWORD(2, 2), &wsaData))
+    {
+        std::cerr << "Can't initialize Winsock" << std::endl;
+        return false;
+    }
+#endif
+    sock = static_cast<intptr_t>(socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP));
+    if(sock < 0)
+    {
+        std::cerr << "Can't create UDP socket" << std::endl;
+        return false;
+    }
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(localPort);
+#ifdef _WINDOWS
+    u_long nonBlocking = 1;
+    bool ok = !ioctlsocket(static_cast<SOCKET>(sock), FIONBIO, &nonBlocking);
+#else
+    bool ok = fcntl(static_cast<int>(sock), F_SETFL, O_NONBLOCK) == 0;
+#endif
+    if(!ok || bind(static_cast<int>(sock), reinterpret_cast<sockaddr*>(&address), sizeof(address)))
+    {
+        std::cerr << "Can't bind UDP port " << localPort << std::endl;
+        close();
+        return false;
+    }
+    this->remotePort = remotePort;
+    return true;
+}
+
+void UdpLink::close()
+{
+    if(sock < 0) return;
+#ifdef _WINDOWS
+    closesocket(static_cast<SOCKET>(sock));
+    WSACleanup();
+#else
+    ::close(static_cast<int>(sock));
+#endif
+    sock = -1;
+    delayed.clear();
+}
+
+void UdpLink::setLatency(int microseconds)
+{
+    latency = microseconds;
+}
+
+void UdpLink::sendDue()
+{
+    int64_t now = TimeSource::getTimeMicroseconds();
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(remotePort);
+    while(!delayed.empty() && delayed.front().time <= now)
+    {
+        // A lost packet is sent again in the next ones
+        if(sendto(static_cast<int>(sock), reinterpret_cast<const char*>(&delayed.front().packet), sizeof(Rollback::Packet),
+                0, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == sizeof(Rollback::Packet))
+            nbSent++;
+        delayed.pop_front();
+    }
+}
+
+void UdpLink::send(const Rollback::Packet &packet)
+{
+    if(sock < 0) return;
+    DelayedPacket delayedPacket;
+    delayedPacket.time = TimeSource::getTimeMicroseconds() + latency;
+    delayedPacket.packet = packet;
+    delayed.push_back(delayedPacket);
+    sendDue();
+}
+
+bool UdpLink::receive(Rollback::Packet &packet)
+{
+    if(sock < 0) return false;
+    sendDue();
+    if(recv(static_cast<int>(sock), reinterpret_cast<char*>(&packet), sizeof(Rollback::Packet), 0)
+            != sizeof(Rollback::Packet))
+        return false;
+    nbReceived++;
+    return true;
+}
+
+uint32_t UdpLink::getNbSent() const
+{
+    return nbSent;
+}
+
+uint32_t UdpLink::getNbReceived() const
+{
+    return nbReceived;
+}
@@ -4,48 +4,41 @@
 #include <array>
 #include <cstdint>
 #include <algorithm>
-#include <fstream>
+#include <cfloat>
+#include <cstdlib>
 #include <GL/glew.h>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_syswm.h>
 #include <thread>
+#include <mutex>
 #include "imgui/imgui.h"
 #include "imgui/imgui_impl_sdl.h"
 #include "imgui/imgui_impl_opengl3.h"
 #include "Inputs.hpp"
 #include "Renderer.hpp"
 #include "DisplayWindow.hpp"
+#include "GameLoop.hpp"
+#include "Headless.hpp"
+#include "TimeSource.hpp"
+#include "Telemetry.hpp"
+#include "LatencySweep.hpp"
+#include "Rollback.hpp"
+#include "Replay.hpp"
+#include "ProgramCache.hpp"
+#include "TextureLoader.hpp"
+#include "GpuTimer.hpp"
+#include "UdpLink.hpp"
 #include "Scenes/Scene.hpp"
 #include "Scenes/AccurateInputLag.hpp"
 #include "Scenes/GhettoInputLag.hpp"
 #include "Scenes/PixelArt.hpp"
 #include "Scenes/Scrolling.hpp"
+#include "Scenes/RectStress.hpp"
 
 #ifdef main
 #undef main
 #endif
 
-enum InputLagMitigation : int8_t
-{
-    none,
-    gpuSync,
-    frameDelay
-};
-
-enum Timestep : int8_t
-{
-    fixed,
-    interpolation,
-    loose,
-    looseInterpolation
-};
-
-int64_t getTimeMicroseconds()
-{
-    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now().time_since_epoch())
-                .count();
-}
-
 void enumCombo(const char *comboName, const char (*enumNames)[40], int8_t &value, int8_t max)
 {
     if(ImGui::BeginCombo(comboName, enumNames[value], 0))
@@ -78,40 +71,186 @@ void gpuHardSync()
     glReadPixels(0, 0, 1, 1, GL_RGB, GL_UNSIGNED_BYTE, col);
 }
 
+// Draws the scene through the renderer context, then scales it to the window with the overlay on top
+class WindowDisplay : public GameLoop::Display
+{
+private:
+    DisplayWindow &window;
+    const int &posX, &posY, &sizeX, &sizeY;
+
+public:
+    DisplayWindow::SyncMode nextSyncMode = DisplayWindow::noVSync;
+    bool drawImGui = true;
+
+    WindowDisplay(DisplayWindow &window, const int &posX, const int &posY, const int &sizeX, const int &sizeY)
+        : window(window), posX(posX), posY(posY), sizeX(sizeX), sizeY(sizeY)
+    {
+    }
+
+    DisplayWindow::SyncMode getSyncMode() const override
+    {
+        return window.getSyncMode();
+    }
+
+    int64_t getRefreshPeriod() override
+    {
+        SDL_DisplayMode displayMode;
+        SDL_GetWindowDisplayMode(window.sdlWindow, &displayMode);
+        return 1000000 / displayMode.refresh_rate;
+    }
+
+    void draw(Scene &scene, const void *state, float alpha, uint16_t simulatedDrawTime) override
+    {
+        int64_t sceneDrawStart = TimeSource::getTimeNanoseconds();
+        GLsync sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        renderer.beginDrawFrame(sync);
+        renderer.gpuTimer.begin(GpuTimer::longDraw);
+        renderer.longDraw(simulatedDrawTime);
+        renderer.gpuTimer.end(GpuTimer::longDraw);
+        renderer.gpuTimer.begin(GpuTimer::sceneDraw);
+        if(state) scene.drawState(state);
+        else scene.drawInterpolated(alpha);
+        // Along with the rects and sprites it flushes
+        renderer.endDrawFrame();
+        renderer.gpuTimer.end(GpuTimer::sceneDraw);
+        renderer.gpuTimer.endFrame();
+        sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        int64_t windowDrawStart = TimeSource::getTimeNanoseconds();
+        telemetry.record(Telemetry::sceneDraw, sceneDrawStart, windowDrawStart);
+
+        int32_t err=glGetError();
+        if(err)
+            std::cerr << "Error frame render " << gluErrorString(err) << std::endl;
+
+        window.useContext();
+        glWaitSync(sync, 0, GL_TIMEOUT_IGNORED);
+        if(drawImGui) ImGui::Render();
+
+        if(window.windowMode == DisplayWindow::WindowMode::windowed)
+        {
+            window.gl.viewport(0, 0, sizeX, sizeY);
+            window.gl.scissor(0, 0, sizeX, sizeY);
+        }
+        else
+        {
+            int wY;
+            SDL_GetWindowSize(window.sdlWindow, nullptr, &wY);
+            window.gl.viewport(posX, -posY + wY - sizeY, sizeX, sizeY);
+            window.gl.scissor(posX, -posY + wY - sizeY, sizeX, sizeY);
+        }
+        window.gpuTimer.begin(GpuTimer::windowDraw);
+        window.draw();
+        window.gpuTimer.end(GpuTimer::windowDraw);
+
+        if(drawImGui)
+        {
+            window.gpuTimer.begin(GpuTimer::imGui);
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+            window.gpuTimer.end(GpuTimer::imGui);
+        }
+        window.gpuTimer.endFrame();
+        telemetry.record(Telemetry::windowDraw, windowDrawStart, TimeSource::getTimeNanoseconds());
+    }
+
+    void swap() override
+    {
+        window.swap();
+    }
+
+    void gpuHardSync() override
+    {
+        ::gpuHardSync();
+    }
+
+    void resync() override
+    {
+        window.setSyncMode(nextSyncMode);
+    }
+};
+
+class DeviceInputs : public GameLoop::InputSource
+{
+private:
+    Inputs &inputs;
+
+public:
+    DeviceInputs(Inputs &inputs) : inputs(inputs)
+    {
+    }
+
+    Inputs::State getState() override
+    {
+        return inputs.getState();
+    }
+};
+
 int main(int argc, char **argv)
 {
-    static constexpr uint8_t MAX_UPDATE_FRAMES_DIV = 10;
-    static constexpr int AUTO_FRAME_DELAY_MARGIN = 1000;
-    static constexpr int SLEEP_MARGIN = 2000;
-    bool missedSync = true;
-    int updateRate = 120;
-    int simulatedUpdateTime = 0; // * 100µs
-    int randomUpdateTime = 0;
-    int simulatedDrawTime = 0; // Arbitrary units
-    int randomDrawTime = 0;
-    int sizeX = NATIVE_RES_X, sizeY = NATIVE_RES_Y, posX, posY;
-    InputLagMitigation inputLagMitigation = InputLagMitigation::none;
-    Timestep timestep = Timestep::fixed;
+    int sizeX = NATIVE_RES_X, sizeY = NATIVE_RES_Y, posX = 0, posY = 0;
+
+    LatencySweep sweep;
+    Inputs inputs;
+    int inputRate = 1000;
+    InputThread::Backend inputBackend = InputThread::sdl;
+    int runAhead = 0;
+    UdpLink udpLink;
+    Rollback rollback(udpLink);
+    bool rollbackEnabled = false;
+    const char *recordPath = nullptr, *replayPath = nullptr;
+    for(int i = 1; i < argc; i++)
+    {
+        if(sweep.parseArgument(argv[i])) continue;
+        if(!strncmp(argv[i], "--input-script=", 15) && !inputs.loadScript(argv[i] + 15))
+            std::cerr << "Invalid input script " << argv[i] + 15 << std::endl;
+        if(!strncmp(argv[i], "--input-presses=", 16))
+        {
+            int nbPresses, period, reaction0, reaction1;
+            if(sscanf(argv[i] + 16, "%d,%d,%d,%d", &nbPresses, &period, &reaction0, &reaction1) == 4)
+                inputs.generateScript(static_cast<uint16_t>(nbPresses), period * 1000, reaction0 * 1000, reaction1 * 1000);
+            else std::cerr << "Expected --input-presses=<count>,<period ms>,<reaction0 ms>,<reaction1 ms>" << std::endl;
+        }
+        if(!strncmp(argv[i], "--input-rate=", 13)) inputRate = atoi(argv[i] + 13);
+        if(!strcmp(argv[i], "--input=evdev")) inputBackend = InputThread::evdev;
+        if(!strncmp(argv[i], "--run-ahead=", 12)) runAhead = atoi(argv[i] + 12);
+        if(!strncmp(argv[i], "--rollback=", 11))
+        {
+            int localPort, remotePort, latency = 0;
+            if(sscanf(argv[i] + 11, "%d,%d,%d", &localPort, &remotePort, &latency) >= 2)
+            {
+                rollbackEnabled = udpLink.open(static_cast<uint16_t>(localPort), static_cast<uint16_t>(remotePort));
+                udpLink.setLatency(latency * 1000);
+            }
+            else std::cerr << "Expected --rollback=<local port>,<remote port>[,<added latency ms>]" << std::endl;
+        }
+        if(!strncmp(argv[i], "--record=", 9)) recordPath = argv[i] + 9;
+        if(!strncmp(argv[i], "--replay=", 9)) replayPath = argv[i] + 9;
+        if(!strcmp(argv[i], "--no-shader-cache")) programCache.enabled = false;
+        if(!strcmp(argv[i], "--no-asset-pack")) textureLoader.usePack = false;
+        if(!strcmp(argv[i], "--no-texture-compression")) textureLoader.useCompression = false;
+        if(!strcmp(argv[i], "--headless")) return runHeadlessSweep(std::cout, 10000000) ? 0 : 1;
+        if(!strncmp(argv[i], "--replay-check=", 15)) return runReplayCheck(std::cout, argv[i] + 15) ? 0 : 1;
+        if(!strcmp(argv[i], "--clock-benchmark"))
+        {
+            TimeSource::runBenchmark(std::cout);
+            return 0;
+        }
+        if(!strncmp(argv[i], "--trace=", 8) && !telemetry.start(argv[i] + 8))
+            std::cerr << "Can't write trace to " << argv[i] + 8 << std::endl;
+        if(!strncmp(argv[i], "--clock=", 8))
+        {
+            int8_t backend = TimeSource::monotonic;
+            while(backend <= TimeSource::tsc && strcmp(argv[i] + 8, TimeSource::backendNames[backend])) backend++;
+            if(backend > TimeSource::tsc || !TimeSource::select(static_cast<TimeSource::Backend>(backend)))
+                std::cerr << "Clock " << argv[i] + 8 << " not available, using "
+                        << TimeSource::backendNames[TimeSource::getBackend()] << std::endl;
+        }
+    }
+
 #ifdef _WINDOWS
     SetProcessDpiAwarenessContext(DPI_AWARENESS_CONTEXT_PER_MONITOR_AWARE_V2);
     //SetProcessDPIAware();
 #endif
 
-    char inputLagMitigationNames[InputLagMitigation::frameDelay + 1][40] =
-    {
-        "None",
-        "GPU hard sync",
-        "Predictive waiting"
-    };
-
-    char timestepNames[Timestep::looseInterpolation + 1][40] =
-    {
-        "Fixed",
-        "Interpolation",
-        "Loose",
-        "Loose + interpolation"
-    };
-
     // Init SDL
     SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER | SDL_INIT_JOYSTICK);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, 0);
@@ -128,78 +267,90 @@ int main(int argc, char **argv)
     //SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 0);
 
     // Init render context
+    int64_t startupStart = TimeSource::getTimeNanoseconds();
     renderer.init();
     SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
 
     // Init Inputs
-    Inputs inputs;
-    bool useSavedInputs = false;
-    Inputs::State savedInputs;
-    inputs.init();
+    inputs.init(inputBackend, inputRate);
 
     // Init window and it's context
     DisplayWindow window;
-    DisplayWindow::SyncMode nextSyncMode = DisplayWindow::noVSync;
+    int64_t windowStart = TimeSource::getTimeNanoseconds();
     window.create();
+    // Shader time and cache hits, cold the first time with a driver, for the start and then each window creation
+    int64_t windowCreateTime = TimeSource::getTimeNanoseconds() - windowStart;
+    ProgramCache::Stats windowShaders = programCache.getStats();
+    // From a window mode or display mode change to the end of the first frame in the new window
+    int64_t switchStart = 0, switchTime = 0;
+    // Printed once the textures requested at start are uploaded, with or without the asset pack
+    bool texturesReported = false;
+    std::cout << "Startup " << (windowStart - startupStart + windowCreateTime) / 1000 << " µs, window "
+            << windowCreateTime / 1000 << " µs, shaders " << windowShaders.time / 1000 << " µs, "
+            << windowShaders.nbCached << " of " << windowShaders.nbPrograms << " programs from the cache" << std::endl;
 
     // Scenes
     AccurateInputLag accurateInputLag;
     GhettoInputLag ghettoInputLag;
     PixelArt pixelArt;
     Scrolling scrolling;
+    RectStress rectStress;
     renderer.useContext();
     pixelArt.init();
-    std::array<Scene*, 4> scenes {{&accurateInputLag, &ghettoInputLag, &pixelArt, &scrolling}};
+    std::array<Scene*, 5> scenes {{&accurateInputLag, &ghettoInputLag, &pixelArt, &scrolling, &rectStress}};
     Scene *currentScene = scenes[0];
-
-    // Chrono
-    int64_t uSeconds = getTimeMicroseconds();
-    int64_t prevUseconds = uSeconds;
-    int64_t toUpdate = 0;
-    int64_t addToUpdate = 0;
-    uint8_t currentFrameUpdate = 0, currentFrameDraw = 0;
-    std::array<int64_t, 16> frameTimes;
-    std::array<int64_t, frameTimes.size()> iterationTimes;
-    std::array<int64_t, frameTimes.size()> remainTimes;
-    std::array<int64_t, 6> singleFrameTimes;
-    std::array<int64_t, singleFrameTimes.size()> drawTimes;
-    for(unsigned int i = 0; i < singleFrameTimes.size(); i++)
+    if(inputs.isScripted()) currentScene = &accurateInputLag;
+
+    // Game loop
+    SystemClock clock;
+    WindowDisplay windowDisplay(window, posX, posY, sizeX, sizeY);
+    DeviceInputs deviceInputs(inputs);
+    GameLoop loop(clock, windowDisplay, deviceInputs);
+    loop.runAhead = std::min(std::max(runAhead, 0), static_cast<int>(GameLoop::MAX_RUN_AHEAD));
+    if(rollbackEnabled) loop.rollback = &rollback;
+
+    // Record or replay
+    Replay replay;
+    loop.replay = &replay;
+    if(replayPath)
     {
-        singleFrameTimes[i] = 1000000;
-        drawTimes[i] = 1000000;
+        if(!replay.play(replayPath))
+        {
+            std::cerr << "Can't play " << replayPath << std::endl;
+            return 1;
+        }
+        auto recorded = std::find_if(scenes.begin(), scenes.end(),
+                [&replay](const Scene *scene) { return !strcmp(scene->getName(), replay.getSceneName()); });
+        if(recorded == scenes.end())
+        {
+            std::cerr << "No scene " << replay.getSceneName() << " to play " << replayPath << " through" << std::endl;
+            return 1;
+        }
+        currentScene = *recorded;
     }
-    for(int64_t &time : remainTimes) time = 0;
-    uint8_t currentFrame = 0;
+    else if(recordPath && !replay.record(recordPath, *currentScene, loop))
+        std::cerr << "Can't record to " << recordPath << std::endl;
 
     // Text
     char text[32] = { 0 };
     SDL_StartTextInput();
 
-    // Auto test
-    int8_t testNumber = -1;
-    uint16_t testRates[] = {24, 30, 48, 60, 72, 120, 144, 300};
-    uint16_t testDrawTimes[] = {150, 350, 500, 0};
-
-    std::ofstream testOutput;
+    // Latency sweep
+    if(sweep.isEnabled() && sweep.start(loop))
+    {
+        currentScene = &accurateInputLag;
+        windowDisplay.nextSyncMode = sweep.getRun().syncMode;
+        loop.requestResync();
+    }
 
     // Main loop
     while(true)
     {
-        // Measure frame rate
-        uint16_t frameRate;
-        int64_t startTime = getTimeMicroseconds();
-        {
-            int64_t prevTime = frameTimes[currentFrame];
-            frameTimes[currentFrame] = startTime;
-            ++currentFrame %= frameTimes.size();
-            frameRate = static_cast<int16_t>(frameTimes.size() * 1000000 / (startTime - prevTime));
-        }
-        uint32_t iterationTime = 0;
-        for(int64_t frameIterationTime : iterationTimes) iterationTime += static_cast<uint32_t>(frameIterationTime);
-        iterationTime /= static_cast<uint32_t>(iterationTimes.size());
+        loop.beginFrame();
 
+        int64_t eventsStart = TimeSource::getTimeNanoseconds();
         SDL_Event event;
-        while (SDL_PollEvent(&event))
+        while (inputs.pollEvent(event))
         {
             ImGui_ImplSDL2_ProcessEvent(&event);
             switch(event.type)
@@ -221,78 +372,18 @@ int main(int argc, char **argv)
             }
         }
 
-        // In case of the game update rate is a multiple or a divider of the monitor refresh rate,
-        // sync them to have constent measurements.
-        bool resync = false;
-        
-        // Auto test
-        Inputs::State prevTestInputs;
-        {
-            Inputs::State inputsState = inputs.getState();
-            if(inputsState.test && !prevTestInputs.test && testNumber < 0)
-            {
-                currentScene = &accurateInputLag;
-                updateRate = testRates[0];
-                simulatedDrawTime = testDrawTimes[0];
-                randomDrawTime = simulatedDrawTime / 5;
-                timestep = fixed;
-                nextSyncMode = DisplayWindow::noVSync;
-                resync = true;
-                inputLagMitigation = none;
-                testNumber = 0;
-                testOutput.open("out.csv", std::ofstream::out | std::ofstream::app);
-            }
-            if(testNumber >= 0 && inputsState.reset && !prevTestInputs.reset)
-            {
-                resync = true;
-                DisplayWindow::SyncMode curMode = window.getSyncMode();
-                float lag0, lag1;
-                std::tie(lag0, lag1) = accurateInputLag.getInputLags();
-                testOutput << simulatedDrawTime << "," << updateRate << "," << curMode << "," << inputLagMitigation <<
-                        "," << timestep << "," << text << "," << lag0 << "," << lag1 << std::endl;
-                switch(inputLagMitigation)
-                {
-                    case none:
-                        inputLagMitigation = gpuSync;
-                        break;
-                    case gpuSync:
-                        if(curMode == DisplayWindow::noVSync)
-                        {
-                            nextSyncMode = DisplayWindow::vSync;
-                            inputLagMitigation = none;
-                        }
-                        else inputLagMitigation = frameDelay;
-                        break;
-                    case frameDelay:
-                        nextSyncMode = DisplayWindow::noVSync;
-                        inputLagMitigation = none;
-                        testNumber++;
-                        uint8_t nbRates = sizeof(testRates) / sizeof(testRates[0]);
-                        uint8_t nbTimes = sizeof(testDrawTimes) / sizeof(testDrawTimes[0]);
-                        if(testNumber >= nbRates * nbTimes)
-                        {
-                            testNumber = -1;
-                            testOutput.close();
-                        }
-                        else
-                        {
-                            updateRate = testRates[testNumber % nbRates];
-                            simulatedDrawTime = testDrawTimes[testNumber / nbRates];
-                            randomDrawTime = simulatedDrawTime / 5;
-                        }
-                }
-
-            }
-            prevTestInputs = inputsState;
-        }
+        telemetry.record(Telemetry::events, eventsStart, TimeSource::getTimeNanoseconds());
 
-        // ImGui
+        // ImGui, the settings and the scene are shared with the update thread
+        std::unique_lock<std::mutex> updateLock(loop.getUpdateMutex());
+        int64_t imGuiStart = TimeSource::getTimeNanoseconds();
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplSDL2_NewFrame(window.sdlWindow);
         ImGui::NewFrame();
         ImGui::Begin("Stuff");
-        ImGui::Text("%6d FPS", frameRate);
-        ImGui::Text("%6d µs", iterationTime);
+        ImGui::Text("%6d FPS", loop.getFrameRate());
+        ImGui::Text("%6d µs", loop.getIterationTime());
+        if(telemetry.isRecording()) ImGui::Text("Recording trace, %u events dropped", telemetry.getNbDropped());
         //if(missedSync) ImGui::Text("VBL missed");
         ImGui::Separator();
         ImGui::Text("Scene");
@@ -312,12 +403,108 @@ int main(int argc, char **argv)
         ImGui::Text((std::string("Keyboard input: ") + text).c_str());
         ImGui::Separator();
         ImGui::Text("Game loop");
-        ImGui::DragInt("Update rate (Hz)", &updateRate, 0.25, 1, 300);
-        enumCombo("Timestep", timestepNames, reinterpret_cast<int8_t&>(timestep), Timestep::looseInterpolation);
-        ImGui::DragInt("Update time *100 µs", &simulatedUpdateTime, 0.25, 0, 1000);
-        ImGui::DragInt("Random update time *100 µs", &randomUpdateTime, 0.25, 0, 1000);
-        ImGui::DragInt("Draw time (arbitrary units)", &simulatedDrawTime, 0.25, 0, 1000);
-        ImGui::DragInt("Random draw time", &randomDrawTime, 0.25, 0, 1000);
+        if(replay.getMode() == Replay::recording) ImGui::Text("Recording, %u ticks", replay.getNbTicks());
+        if(replay.getMode() == Replay::playing)
+            ImGui::Text("Playing tick %u of %u, %u hash mismatches", replay.getTickPos(), replay.getNbTicks(),
+                    replay.getNbMismatches());
+        ImGui::DragInt("Update rate (Hz)", &loop.updateRate, 0.25, 1, 300);
+        enumCombo("Timestep", GameLoop::timestepNames, reinterpret_cast<int8_t&>(loop.timestep), GameLoop::Timestep::looseInterpolation);
+        enumCombo("Threading", GameLoop::threadingNames, reinterpret_cast<int8_t&>(loop.threading), GameLoop::Threading::updateThread);
+        ImGui::DragInt("Run-ahead (ticks)", &loop.runAhead, 0.1f, 0, GameLoop::MAX_RUN_AHEAD);
+        if(loop.runAhead) ImGui::Text("Run-ahead cost %6.1f µs per tick", loop.getRunAheadCost());
+        accurateInputLag.setRunAhead(static_cast<uint8_t>(loop.runAhead));
+        ImGui::DragInt("Update time *100 µs", &loop.simulatedUpdateTime, 0.25, 0, 1000);
+        ImGui::DragInt("Random update time *100 µs", &loop.randomUpdateTime, 0.25, 0, 1000);
+        ImGui::DragInt("Draw time (arbitrary units)", &loop.simulatedDrawTime, 0.25, 0, 1000);
+        if(renderer.gpuTimer.isSupported())
+            ImGui::Text("Long draw on the GPU: p50 %7.1f µs",
+                    renderer.gpuTimer.getPercentile(GpuTimer::longDraw, 0.5f));
+        ImGui::DragInt("Random draw time", &loop.randomDrawTime, 0.25, 0, 1000);
+        if(ImGui::CollapsingHeader("Wait engine"))
+        {
+            const PreciseWait::Stats &waitStats = clock.preciseWait.getStats();
+            float oversleep[PreciseWait::NB_BUCKETS], lateness[PreciseWait::NB_BUCKETS];
+            for(uint8_t i = 0; i < PreciseWait::NB_BUCKETS; i++)
+            {
+                oversleep[i] = static_cast<float>(waitStats.oversleep[i]);
+                lateness[i] = static_cast<float>(waitStats.lateness[i]);
+            }
+            ImGui::Text("Clock: %s", TimeSource::backendNames[TimeSource::getBackend()]);
+            ImGui::DragFloat("Target percentile", &clock.preciseWait.percentile, 0.001f, 0.5f, 1.f);
+            ImGui::Text("Spin margin %6d µs", static_cast<int>(clock.preciseWait.getMargin()));
+            if(waitStats.nbWaits)
+                ImGui::Text("Per wait: sleep %6d µs, spin %6d µs",
+                        static_cast<int>(waitStats.totalSleep / waitStats.nbWaits),
+                        static_cast<int>(waitStats.totalSpin / waitStats.nbWaits));
+            ImGui::PlotHistogram("Oversleep (log2 µs)", oversleep, PreciseWait::NB_BUCKETS, 0, nullptr, 0, FLT_MAX,
+                    ImVec2(0, 60));
+            ImGui::PlotHistogram("Lateness (log2 µs)", lateness, PreciseWait::NB_BUCKETS, 0, nullptr, 0, FLT_MAX,
+                    ImVec2(0, 60));
+            if(ImGui::Button("Reset wait stats")) clock.preciseWait.resetStats();
+        }
+        if(ImGui::CollapsingHeader("Inputs"))
+        {
+            ImGui::Text("Backend: %s", InputThread::backendNames[inputs.getBackend()]);
+            ImGui::Text("Delayed transitions: %u", inputs.getNbDelayedTransitions());
+            const Inputs::KeyDelay &keyDelay = inputs.getSdlKeyDelay();
+            if(keyDelay.count)
+                ImGui::Text("SDL key events after evdev: mean %6d µs, max %6d µs (%u presses)",
+                        static_cast<int>(keyDelay.total / keyDelay.count / 1000), static_cast<int>(keyDelay.max / 1000),
+                        keyDelay.count);
+        }
+        if(loop.rollback && ImGui::CollapsingHeader("Rollback"))
+        {
+            const Rollback::Stats &stats = rollback.getStats();
+            if(!rollback.isConnected()) ImGui::Text("Waiting for the other instance");
+            else ImGui::Text("Tick %u, remote inputs up to %u", rollback.getTick(), rollback.getRemoteTick());
+            ImGui::Text("Packets: %u sent, %u received", udpLink.getNbSent(), udpLink.getNbReceived());
+            if(stats.nbRollbacks)
+            {
+                ImGui::Text("%u rollbacks, depth mean %.1f max %u ticks", stats.nbRollbacks,
+                        static_cast<float>(stats.totalDepth) / stats.nbRollbacks, stats.maxDepth);
+                ImGui::Text("Resimulation: last %6d µs, mean %6d µs, max %6d µs",
+                        static_cast<int>(stats.lastResimTime / 1000),
+                        static_cast<int>(stats.totalResimTime / stats.nbRollbacks / 1000),
+                        static_cast<int>(stats.maxResimTime / 1000));
+            }
+            ImGui::Text("Ticks waiting %u, skipped %u", stats.nbWaits, stats.nbSkips);
+            if(rollback.getTick())
+                ImGui::Text("State hash %016llx", static_cast<unsigned long long>(rollback.getHash(rollback.getTick() - 1)));
+            ImGui::Text("Hash checks %u, desyncs %u", stats.nbChecks, stats.nbDesyncs);
+            if(stats.nbDesyncs) ImGui::Text("First desync at tick %u", stats.firstDesync);
+        }
+        if(ImGui::CollapsingHeader("GPU time"))
+        {
+            if(!renderer.gpuTimer.isSupported()) ImGui::Text("No timer queries");
+            else for(int8_t pass = GpuTimer::longDraw; pass <= GpuTimer::imGui; pass++)
+            {
+                // Each pass is timed in the context drawing it
+                const GpuTimer &timer = pass <= GpuTimer::sceneDraw ? renderer.gpuTimer : window.gpuTimer;
+                GpuTimer::Pass timed = static_cast<GpuTimer::Pass>(pass);
+                ImGui::PlotLines(GpuTimer::passNames[timed], timer.getHistory(timed), timer.getNbSamples(timed),
+                        timer.getHistoryOffset(timed), nullptr, 0, FLT_MAX, ImVec2(0, 40));
+                ImGui::Text("p50 %7.1f µs  p90 %7.1f µs  p99 %7.1f µs", timer.getPercentile(timed, 0.5f),
+                        timer.getPercentile(timed, 0.9f), timer.getPercentile(timed, 0.99f));
+            }
+            if(renderer.gpuTimer.isSupported())
+                ImGui::Text("Frames not read back in time: %u", renderer.gpuTimer.getNbDropped()
+                        + window.gpuTimer.getNbDropped());
+        }
+        if(ImGui::CollapsingHeader("Renderer"))
+        {
+            ImGui::Text("Streaming: %s, %u KB buffer", renderer.stream.isPersistent() ? "persistent map" : "orphaning",
+                    static_cast<unsigned>(renderer.stream.getSize() / 1024));
+            ImGui::Text("%6u KB per frame, waited %6d µs", static_cast<unsigned>(renderer.stream.getFrameBytes() / 1024),
+                    static_cast<int>(renderer.stream.getWaitTime() / 1000));
+            ImGui::Text("Window creation %6d µs, shaders %6d µs, %u of %u programs cached",
+                    static_cast<int>(windowCreateTime / 1000), static_cast<int>(windowShaders.time / 1000),
+                    windowShaders.nbCached, windowShaders.nbPrograms);
+            if(switchTime) ImGui::Text("Last mode switch %6d µs to the first frame", static_cast<int>(switchTime / 1000));
+            ImGui::Text("GL state per frame: scene %u set, %u elided; window %u set, %u elided",
+                    renderer.gl.getNbIssued(), renderer.gl.getNbElided(), window.gl.getNbIssued(),
+                    window.gl.getNbElided());
+            ImGui::Text("%u textures loading", textureLoader.getNbPending());
+        }
         ImGui::Separator();
         ImGui::Text("Settings");
         int nbDisplays = SDL_GetNumVideoDisplays();
@@ -377,7 +564,8 @@ int main(int argc, char **argv)
 
         if(recreateWindow)
         {
-            resync = true;
+            switchStart = TimeSource::getTimeNanoseconds();
+            loop.requestResync();
             window.destroy();
             renderer.useContext();
             SDL_Rect rect;
@@ -399,12 +587,15 @@ int main(int argc, char **argv)
                     computeWindowSize(posX, posY, sizeX, sizeY);
                 break;
             }
+            ProgramCache::Stats shadersBefore = programCache.getStats();
+            windowStart = TimeSource::getTimeNanoseconds();
             window.create();
+            windowCreateTime = TimeSource::getTimeNanoseconds() - windowStart;
+            windowShaders = programCache.getStats();
+            windowShaders.nbPrograms -= shadersBefore.nbPrograms;
+            windowShaders.nbCached -= shadersBefore.nbCached;
+            windowShaders.time -= shadersBefore.time;
             SDL_SetWindowInputFocus(window.sdlWindow);
-            ImGui_ImplOpenGL3_NewFrame();
-            ImGui_ImplSDL2_NewFrame(window.sdlWindow);
-            ImGui::NewFrame();
-            ImGui::Begin("Stuff");
         }
 
         if(window.windowMode == DisplayWindow::WindowMode::windowed)
@@ -435,234 +626,76 @@ int main(int argc, char **argv)
                 if(window.isSyncModeAvailable(static_cast<DisplayWindow::SyncMode>(i))
                     && ImGui::Selectable(DisplayWindow::syncModeNames[i], i == syncMode))
             {
-                nextSyncMode = static_cast<DisplayWindow::SyncMode>(i);
+                windowDisplay.nextSyncMode = static_cast<DisplayWindow::SyncMode>(i);
                 window.setSyncMode(DisplayWindow::vSync);
-                resync = true;
+                loop.requestResync();
             }
             ImGui::EndCombo();
         }
-        enumCombo("Input lag mitigation", inputLagMitigationNames, reinterpret_cast<int8_t&>(inputLagMitigation),
-                syncMode == DisplayWindow::SyncMode::noVSync ? InputLagMitigation::gpuSync
-                                                             : InputLagMitigation::frameDelay);
-        ImGui::End();
-
-        syncMode = window.getSyncMode();
-        if(syncMode == DisplayWindow::SyncMode::noVSync && inputLagMitigation == InputLagMitigation::frameDelay)
-            inputLagMitigation = InputLagMitigation::gpuSync;
-
-        // Update
-        uSeconds = startTime;// getTimeMicroseconds();
-        int64_t dToUpdate = (uSeconds - prevUseconds) * updateRate;
-        toUpdate += dToUpdate;
-        prevUseconds = uSeconds;
-
-        uint8_t maxUpdateFrames = (updateRate / MAX_UPDATE_FRAMES_DIV) + 2;
-        if(toUpdate > 1000000 * maxUpdateFrames) toUpdate = 1000000 * maxUpdateFrames;
-        uint8_t nbFramesToUpdate = 0;
-        if(window.getSyncMode() == DisplayWindow::noVSync && timestep == fixed)
-        {
-            while(toUpdate <= 1000000)
-            {
-                int64_t sleepTime = (1000000 - toUpdate) / updateRate - SLEEP_MARGIN;
-                if(sleepTime > 0) std::this_thread::sleep_for(std::chrono::microseconds(sleepTime));
-                uSeconds = getTimeMicroseconds();
-                dToUpdate = (uSeconds - prevUseconds) * updateRate;
-                toUpdate += dToUpdate;
-                prevUseconds = uSeconds;
-                if(inputLagMitigation == InputLagMitigation::gpuSync) gpuHardSync();
-            }
-        }
-
-        SDL_DisplayMode displayMode;
-        SDL_GetWindowDisplayMode(window.sdlWindow, &displayMode);
-        int64_t displayRefreshPeriod = 1000000 / displayMode.refresh_rate;
-        int64_t waitTime = *std::min_element(remainTimes.cbegin(), remainTimes.cend()) - AUTO_FRAME_DELAY_MARGIN;
-        if(!missedSync && inputLagMitigation == InputLagMitigation::frameDelay && waitTime > 0)
-        {
-            while(true)
-            {
-                int64_t micros = getTimeMicroseconds();
-                if(micros < uSeconds + waitTime)
-                {
-                    int64_t sleepTime = uSeconds + waitTime - micros - SLEEP_MARGIN;              
-                    if(sleepTime > 0) std::this_thread::sleep_for(std::chrono::microseconds(sleepTime));
-                }
-                else break;
-            }
-        }
-        else waitTime = 0;
-
-        int64_t updateStartTime = uSeconds = getTimeMicroseconds();
-        switch(timestep)
-        {
-            case Timestep::fixed:
-                while(toUpdate > 1000000)
-                {
-                    int64_t frameTime = getTimeMicroseconds();
-                    currentScene->update(1000000 / updateRate, inputs.getState());
-                    frameTime = getTimeMicroseconds() - frameTime;
-                    if(frameTime < simulatedUpdateTime * 100) frameTime = simulatedUpdateTime * 100;
-                    singleFrameTimes[currentFrameUpdate] = frameTime;
-                    ++currentFrameUpdate %= singleFrameTimes.size();
-                    toUpdate -= 1000000;
-                    nbFramesToUpdate++;
-                }
-                currentScene->saveState();
-                break;
-            case Timestep::interpolation:
-                currentScene->loadState();
-                while(toUpdate > 1000000)
-                {
-                    int64_t frameTime = getTimeMicroseconds();
-                    currentScene->update(1000000 / updateRate, useSavedInputs ? savedInputs : inputs.getState());
-                    useSavedInputs = false;
-                    frameTime = getTimeMicroseconds() - frameTime;
-                    if(frameTime < simulatedUpdateTime * 100) frameTime = simulatedUpdateTime * 100;
-                    singleFrameTimes[currentFrameUpdate] = frameTime;
-                    ++currentFrameUpdate %= singleFrameTimes.size();
-                    toUpdate -= 1000000;
-                    nbFramesToUpdate++;
-                }
-                currentScene->saveState();
-                if(toUpdate > 0)
-                {
-                    if(!useSavedInputs)
-                    {
-                        savedInputs = inputs.getState();
-                        useSavedInputs = true;
-                    }
-                    currentScene->update(toUpdate / updateRate, savedInputs);
-                    nbFramesToUpdate++;
-                }
-                break;
-            case Timestep::loose:
-                currentScene->loadState();
-                while(toUpdate > 1000000)
-                {
-                    int64_t frameTime = getTimeMicroseconds();
-                    currentScene->update((1000000 + addToUpdate) / updateRate, useSavedInputs ? savedInputs : inputs.getState());
-                    useSavedInputs = false;
-                    addToUpdate = 0;
-                    frameTime = getTimeMicroseconds() - frameTime;
-                    if(frameTime < simulatedUpdateTime * 100) frameTime = simulatedUpdateTime * 100;
-                    singleFrameTimes[currentFrameUpdate] = frameTime;
-                    ++currentFrameUpdate %= singleFrameTimes.size();
-                    toUpdate -= 1000000;
-                    nbFramesToUpdate++;
-                }
-                currentScene->saveState();
-                if(toUpdate > 0 && addToUpdate < 0 && toUpdate + dToUpdate >= 1000000)
-                {
-                    currentScene->update((toUpdate + addToUpdate) / updateRate, useSavedInputs ? savedInputs : inputs.getState());
-                    useSavedInputs = false;
-                    addToUpdate = 1000000 - (toUpdate + addToUpdate);
-                    toUpdate -= 1000000;
-                    nbFramesToUpdate++;
-                    currentScene->saveState();
-                }
-                break;
-            case Timestep::looseInterpolation:
-                currentScene->loadState();
-                while(toUpdate > 1000000)
-                {
-                    int64_t frameTime = getTimeMicroseconds();
-                    currentScene->update((1000000 + addToUpdate) / updateRate, useSavedInputs ? savedInputs : inputs.getState());
-                    useSavedInputs = false;
-                    addToUpdate = 0;
-                    frameTime = getTimeMicroseconds() - frameTime;
-                    if(frameTime < simulatedUpdateTime * 100) frameTime = simulatedUpdateTime * 100;
-                    singleFrameTimes[currentFrameUpdate] = frameTime;
-                    ++currentFrameUpdate %= singleFrameTimes.size();
-                    toUpdate -= 1000000;
-                    nbFramesToUpdate++;
-                }
-                currentScene->saveState();
-                if(addToUpdate > 0 || toUpdate + dToUpdate < 1000000)
-                {
-                    if(!useSavedInputs)
-                    {
-                        savedInputs = inputs.getState();
-                        useSavedInputs = true;
-                    }
-                    currentScene->update((toUpdate + addToUpdate) / updateRate, savedInputs);
-                    nbFramesToUpdate++;
-                }
-                else if(toUpdate > 0)
-                {
-                    currentScene->update(toUpdate / updateRate, useSavedInputs ? savedInputs : inputs.getState());
-                    useSavedInputs = false;
-                    addToUpdate = 1000000 - toUpdate;
-                    toUpdate -= 1000000;
-                    nbFramesToUpdate++;
-                    currentScene->saveState();
-                }
-                break;
-        }
+        enumCombo("Input lag mitigation", GameLoop::inputLagMitigationNames, reinterpret_cast<int8_t&>(loop.inputLagMitigation),
+                syncMode == DisplayWindow::SyncMode::noVSync ? GameLoop::InputLagMitigation::gpuSync
+                                                             : GameLoop::InputLagMitigation::frameDelay);
+        if(loop.inputLagMitigation == GameLoop::InputLagMitigation::frameDelay)
         {
-            int64_t endTime = uSeconds + nbFramesToUpdate
-                    * (simulatedUpdateTime + (randomUpdateTime ? rand() % randomUpdateTime : 0)) * 100;
-            while(getTimeMicroseconds() < endTime);
+            FrameDelayPredictor &predictor = loop.frameDelayPredictor;
+            float missRate = predictor.missRate * 100;
+            ImGui::DragFloat("Target missed frames (%)", &missRate, 0.05f, 0.1f, 50.f);
+            predictor.missRate = missRate / 100;
+            ImGui::Text("Margin %6d µs, %d missed", static_cast<int>(predictor.getMargin()),
+                    predictor.getNbMissedSyncs());
+            for(int8_t cost = FrameDelayPredictor::update; cost <= FrameDelayPredictor::total; cost++)
+                ImGui::Text("%-8s p50 %6d µs  p%02d %6d µs", FrameDelayPredictor::costNames[cost],
+                        static_cast<int>(predictor.getPercentile(static_cast<FrameDelayPredictor::Cost>(cost), 0.5f)),
+                        static_cast<int>(100 - missRate),
+                        static_cast<int>(predictor.getPercentile(static_cast<FrameDelayPredictor::Cost>(cost),
+                                1.f - predictor.missRate)));
         }
+        ImGui::End();
+        windowDisplay.drawImGui = !sweep.isEnabled();
+        telemetry.record(Telemetry::imGui, imGuiStart, TimeSource::getTimeNanoseconds());
+        updateLock.unlock();
 
-        // Draw
-        int64_t startDrawTime = getTimeMicroseconds();
-        GLsync sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
-        renderer.beginDrawFrame(sync);
-        renderer.longDraw(simulatedDrawTime + (randomDrawTime ? rand() % randomDrawTime : 0));
-        currentScene->draw();
-        renderer.endDrawFrame();
-        sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
-
-        int32_t err=glGetError();
-        if(err)
-            std::cerr << "Error frame render " << gluErrorString(err) << std::endl;
-
-        window.useContext();
-        glWaitSync(sync, 0, GL_TIMEOUT_IGNORED);
-        if(testNumber < 0) ImGui::Render();
-
-        if(window.windowMode == DisplayWindow::WindowMode::windowed)
+        loop.endFrame(*currentScene);
+        if(switchStart)
         {
-            glViewport(0, 0, sizeX, sizeY);
-            glScissor(0, 0, sizeX, sizeY);
+            switchTime = TimeSource::getTimeNanoseconds() - switchStart;
+            switchStart = 0;
+            std::cout << "Mode switch " << switchTime / 1000 << " µs to the first frame, window creation "
+                    << windowCreateTime / 1000 << " µs" << std::endl;
         }
-        else
+        if(!texturesReported && !textureLoader.getNbPending())
         {
-            int wY;
-            SDL_GetWindowSize(window.sdlWindow, nullptr, &wY);
-            glViewport(posX, -posY + wY - sizeY, sizeX, sizeY);
-            glScissor(posX, -posY + wY - sizeY, sizeX, sizeY);
+            texturesReported = true;
+            TextureLoader::Stats textures = textureLoader.getStats();
+            if(textures.nbLoaded) std::cout << "Textures ready " << (textures.lastReady - startupStart) / 1000
+                    << " µs after the start, " << textures.nbFromPack << " of " << textures.nbLoaded
+                    << " from the asset pack, decode " << textures.decodeTime / 1000 << " µs, "
+                    << textures.uploadedBytes / 1024 << " KB instead of " << textures.rgbaBytes / 1024 << " KB as RGBA"
+                    << std::endl;
         }
-        window.draw();
 
-        if(testNumber < 0) ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-        int64_t drawTime = getTimeMicroseconds() - startDrawTime;
-        //if(drawTime < simulatedDrawTime * 100) drawTime = simulatedDrawTime * 100;
-        drawTimes[currentFrameDraw] = drawTime;
-        ++currentFrameDraw %= drawTimes.size();
-        if(inputLagMitigation >= InputLagMitigation::frameDelay) gpuHardSync();
-        int64_t beforeSwapTime = getTimeMicroseconds();
-        window.swap();
-        if(resync || inputLagMitigation >= InputLagMitigation::gpuSync) gpuHardSync();
-        if(resync)
+        if(replayPath && replay.getMode() == Replay::finished)
         {
-            toUpdate = 0;
-            window.setSyncMode(nextSyncMode);
+            replay.writeSummary(std::cout);
+            return 0;
         }
-        int64_t afterSwapTime = getTimeMicroseconds();
-        if(inputLagMitigation >= InputLagMitigation::gpuSync) switch(window.getSyncMode())
+        if(sweep.isEnabled()) switch(sweep.afterFrame())
         {
-            case DisplayWindow::SyncMode::noVSync:
-                missedSync = false;
+            case LatencySweep::running:
                 break;
-            case DisplayWindow::SyncMode::adaptiveSync:
-            case DisplayWindow::SyncMode::vSync:
-                int64_t remainingTime = displayRefreshPeriod - (beforeSwapTime - startTime) + waitTime;
-                remainTimes[currentFrame] = remainingTime;
-                missedSync = (afterSwapTime - startTime) >= displayRefreshPeriod * 1.1;
+            case LatencySweep::nextConfig:
+                windowDisplay.nextSyncMode = sweep.getRun().syncMode;
+                loop.requestResync();
                 break;
+            case LatencySweep::done:
+                return 0;
+        }
+        else if(inputs.isScriptFinished())
+        {
+            float lag0, lag1;
+            std::tie(lag0, lag1) = accurateInputLag.getInputLags();
+            std::cout << "Input lag: " << lag0 << " " << lag1 << " ticks" << std::endl;
+            return 0;
         }
-        else missedSync = false;
-        iterationTimes[currentFrame] = afterSwapTime - updateStartTime;
     }
 }
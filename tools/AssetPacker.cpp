@@ -0,0 +1,224 @@
+// Converts images into a pack the game maps instead of decoding them at start:
+// asset-packer <pack> <image>...
+// Each image is stored under the path given here, which is the one the game loads it with, as RGBA and compressed
+// to BC1 when opaque or BC3 otherwise. The game picks the compressed one when the driver has S3TC.
+#define SDL_MAIN_HANDLED
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include "AssetPack.hpp"
+
+struct Packed
+{
+    AssetPack::Entry entry;
+    std::vector<uint8_t> data;
+};
+
+static uint16_t to565(const uint8_t *color)
+{
+    return static_cast<uint16_t>((color[0] >> 3) << 11 | (color[1] >> 2) << 5 | color[2] >> 3);
+}
+
+// Back to 8 bits a channel, the way the GPU expands it
+static void from565(uint16_t value, int *color)
+{
+    int r = value >> 11, g = (value >> 5) & 63, b = value & 31;
+    color[0] = r << 3 | r >> 2;
+    color[1] = g << 2 | g >> 4;
+    color[2] = b << 3 | b >> 2;
+}
+
+// The two texels furthest apart as end points, exact for the blocks of two colors pixel art mostly has,
+// then each texel to the nearest of the four colors between them
+static void encodeColors(const uint8_t texels[16][4], uint8_t *block)
+{
+    int first = 0, last = 0, maxDistance = -1;
+    for(int i = 0; i < 16; i++) for(int j = i + 1; j < 16; j++)
+    {
+        int distance = 0;
+        for(int c = 0; c < 3; c++) distance += (texels[i][c] - texels[j][c]) * (texels[i][c] - texels[j][c]);
+        if(distance > maxDistance)
+        {
+            maxDistance = distance;
+            first = i;
+            last = j;
+        }
+    }
+    uint16_t color0 = to565(texels[first]), color1 = to565(texels[last]);
+    // Four colors when the first is greater, three and transparent black otherwise
+    if(color0 < color1) std::swap(color0, color1);
+    int palette[4][3];
+    from565(color0, palette[0]);
+    from565(color1, palette[1]);
+    for(int c = 0; c < 3; c++)
+    {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+    uint32_t indices = 0;
+    // Both the same, all of them take the first
+    if(color0 != color1) for(int i = 0; i < 16; i++)
+    {
+        uint32_t nearest = 0;
+        int minDistance = INT32_MAX;
+        for(uint32_t p = 0; p < 4; p++)
+        {
+            int distance = 0;
+            for(int c = 0; c < 3; c++) distance += (palette[p][c] - texels[i][c]) * (palette[p][c] - texels[i][c]);
+            if(distance < minDistance)
+            {
+                minDistance = distance;
+                nearest = p;
+            }
+        }
+        indices |= nearest << (2 * i);
+    }
+    block[0] = static_cast<uint8_t>(color0);
+    block[1] = static_cast<uint8_t>(color0 >> 8);
+    block[2] = static_cast<uint8_t>(color1);
+    block[3] = static_cast<uint8_t>(color1 >> 8);
+    for(int b = 0; b < 4; b++) block[4 + b] = static_cast<uint8_t>(indices >> (8 * b));
+}
+
+// Minimum and maximum as end points, with the six values between them
+static void encodeAlpha(const uint8_t texels[16][4], uint8_t *block)
+{
+    uint8_t alpha0 = 0, alpha1 = 255;
+    for(int i = 0; i < 16; i++)
+    {
+        alpha0 = std::max(alpha0, texels[i][3]);
+        alpha1 = std::min(alpha1, texels[i][3]);
+    }
+    uint64_t indices = 0;
+    if(alpha0 > alpha1) for(int i = 0; i < 16; i++)
+    {
+        uint64_t nearest = 0;
+        int minDistance = 256;
+        for(int k = 0; k < 8; k++)
+        {
+            int value = k == 0 ? alpha0 : k == 1 ? alpha1 : ((8 - k) * alpha0 + (k - 1) * alpha1) / 7;
+            if(std::abs(value - texels[i][3]) < minDistance)
+            {
+                minDistance = std::abs(value - texels[i][3]);
+                nearest = static_cast<uint64_t>(k);
+            }
+        }
+        indices |= nearest << (3 * i);
+    }
+    block[0] = alpha0;
+    block[1] = alpha1;
+    for(int b = 0; b < 6; b++) block[2 + b] = static_cast<uint8_t>(indices >> (8 * b));
+}
+
+static std::vector<uint8_t> compress(AssetPack::Format format, const std::vector<uint8_t> &pixels, int w, int h)
+{
+    std::vector<uint8_t> blocks(AssetPack::getDataSize(format, w, h));
+    uint8_t *block = blocks.data();
+    for(int blockY = 0; blockY < h; blockY += 4) for(int blockX = 0; blockX < w; blockX += 4)
+    {
+        // The edge repeated past the image
+        uint8_t texels[16][4];
+        for(int y = 0; y < 4; y++) for(int x = 0; x < 4; x++)
+        {
+            size_t texel = static_cast<size_t>(std::min(blockY + y, h - 1)) * w + std::min(blockX + x, w - 1);
+            memcpy(texels[y * 4 + x], &pixels[texel * 4], 4);
+        }
+        if(format == AssetPack::bc3)
+        {
+            encodeAlpha(texels, block);
+            block += 8;
+        }
+        encodeColors(texels, block);
+        block += 8;
+    }
+    return blocks;
+}
+
+static void addEntry(std::vector<Packed> &packed, const char *name, AssetPack::Format format, int w, int h,
+        std::vector<uint8_t> data)
+{
+    Packed entry = {};
+    strcpy(entry.entry.name, name);
+    entry.entry.format = format;
+    entry.entry.w = static_cast<uint16_t>(w);
+    entry.entry.h = static_cast<uint16_t>(h);
+    entry.entry.size = data.size();
+    entry.data = std::move(data);
+    packed.push_back(std::move(entry));
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " <pack> <image>..." << std::endl;
+        return 1;
+    }
+    std::vector<Packed> packed;
+    for(int i = 2; i < argc; i++)
+    {
+        SDL_Surface *loaded = IMG_Load(argv[i]);
+        SDL_Surface *surface = loaded ? SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_RGBA32, 0) : nullptr;
+        if(loaded) SDL_FreeSurface(loaded);
+        if(!surface || strlen(argv[i]) >= AssetPack::NAME_SIZE || surface->w > UINT16_MAX || surface->h > UINT16_MAX)
+        {
+            std::cerr << "Can't pack " << argv[i] << std::endl;
+            if(surface) SDL_FreeSurface(surface);
+            return 1;
+        }
+        int w = surface->w, h = surface->h;
+        size_t rowSize = static_cast<size_t>(w) * 4;
+        std::vector<uint8_t> pixels(rowSize * h);
+        for(int y = 0; y < h; y++)
+            memcpy(&pixels[y * rowSize], static_cast<const uint8_t*>(surface->pixels) + y * surface->pitch, rowSize);
+        SDL_FreeSurface(surface);
+
+        bool opaque = true;
+        for(size_t texel = 0; texel < pixels.size(); texel += 4) opaque &= pixels[texel + 3] == 255;
+        AssetPack::Format format = opaque ? AssetPack::bc1 : AssetPack::bc3;
+        std::vector<uint8_t> blocks = compress(format, pixels, w, h);
+        // Texels sampled cost the same ratio of bandwidth as of memory
+        std::cout << argv[i] << " " << w << "x" << h << ": " << AssetPack::formatNames[format] << " "
+                << blocks.size() / 1024 << " KB instead of " << pixels.size() / 1024 << " KB, "
+                << static_cast<float>(pixels.size()) / blocks.size() << "x less memory and texture bandwidth"
+                << std::endl;
+        addEntry(packed, argv[i], AssetPack::rgba8, w, h, std::move(pixels));
+        addEntry(packed, argv[i], format, w, h, std::move(blocks));
+    }
+
+    uint64_t offset = sizeof(AssetPack::Header) + packed.size() * sizeof(AssetPack::Entry);
+    for(Packed &entry : packed)
+    {
+        offset = (offset + AssetPack::DATA_ALIGNMENT - 1) / AssetPack::DATA_ALIGNMENT * AssetPack::DATA_ALIGNMENT;
+        entry.entry.offset = offset;
+        offset += entry.entry.size;
+    }
+    AssetPack::Header header = {};
+    memcpy(header.magic, AssetPack::MAGIC, sizeof(header.magic));
+    header.version = AssetPack::VERSION;
+    header.nbEntries = static_cast<uint32_t>(packed.size());
+    std::ofstream out(argv[1], std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for(const Packed &entry : packed) out.write(reinterpret_cast<const char*>(&entry.entry), sizeof(entry.entry));
+    uint64_t written = sizeof(header) + packed.size() * sizeof(AssetPack::Entry);
+    for(const Packed &entry : packed)
+    {
+        // Padding up to the entry's offset
+        std::vector<char> padding(static_cast<size_t>(entry.entry.offset - written));
+        out.write(padding.data(), padding.size());
+        out.write(reinterpret_cast<const char*>(entry.data.data()), entry.data.size());
+        written = entry.entry.offset + entry.entry.size;
+    }
+    if(!out)
+    {
+        std::cerr << "Can't write " << argv[1] << std::endl;
+        return 1;
+    }
+    std::cout << "Packed " << argc - 2 << " images, " << offset / 1024 << " KB" << std::endl;
+    return 0;
+}